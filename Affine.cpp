@@ -0,0 +1,393 @@
+#include "Affine.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AFFINE_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(AFFINE_SSE) && defined(__AVX2__)
+#define AFFINE_AVX2 1
+#include <immintrin.h>
+#endif
+
+//---------------------------
+//TRS -> rotation/scale/translation rows, written once for any "lane" type
+// (float for the scalar path, __m128 / __m256 for the SIMD paths):
+
+namespace {
+
+struct Lanes1 {
+	typedef float V;
+	static V splat(float f) { return f; }
+	static V add(V a, V b) { return a + b; }
+	static V sub(V a, V b) { return a - b; }
+	static V mul(V a, V b) { return a * b; }
+};
+
+#ifdef AFFINE_SSE
+struct Lanes4 {
+	typedef __m128 V;
+	static V splat(float f) { return _mm_set1_ps(f); }
+	static V add(V a, V b) { return _mm_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+};
+#endif
+
+#ifdef AFFINE_AVX2
+struct Lanes8 {
+	typedef __m256 V;
+	static V splat(float f) { return _mm256_set1_ps(f); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+};
+#endif
+
+template< typename L >
+struct TRS {
+	typedef typename L::V V;
+	V px, py, pz;
+	V qx, qy, qz, qw;
+	V sx, sy, sz;
+
+	//out[r][c] is row r, column c of translate * mat3_cast(q) * scale:
+	void compose(V out[3][4]) const {
+		V two = L::splat(2.0f);
+		V one = L::splat(1.0f);
+		V xx = L::mul(qx, qx), yy = L::mul(qy, qy), zz = L::mul(qz, qz);
+		V xy = L::mul(qx, qy), xz = L::mul(qx, qz), yz = L::mul(qy, qz);
+		V wx = L::mul(qw, qx), wy = L::mul(qw, qy), wz = L::mul(qw, qz);
+
+		out[0][0] = L::mul(L::sub(one, L::mul(two, L::add(yy, zz))), sx);
+		out[0][1] = L::mul(L::mul(two, L::sub(xy, wz)), sy);
+		out[0][2] = L::mul(L::mul(two, L::add(xz, wy)), sz);
+		out[0][3] = px;
+
+		out[1][0] = L::mul(L::mul(two, L::add(xy, wz)), sx);
+		out[1][1] = L::mul(L::sub(one, L::mul(two, L::add(xx, zz))), sy);
+		out[1][2] = L::mul(L::mul(two, L::sub(yz, wx)), sz);
+		out[1][3] = py;
+
+		out[2][0] = L::mul(L::mul(two, L::sub(xz, wy)), sx);
+		out[2][1] = L::mul(L::mul(two, L::add(yz, wx)), sy);
+		out[2][2] = L::mul(L::sub(one, L::mul(two, L::add(xx, yy))), sz);
+		out[2][3] = pz;
+	}
+};
+
+} //namespace
+
+#ifdef AFFINE_SSE
+//write four records' worth of lanes out as four Affines:
+static inline void store4(__m128 lanes[3][4], Affine *out) {
+	for (int r = 0; r < 3; ++r) {
+		__m128 c0 = lanes[r][0], c1 = lanes[r][1], c2 = lanes[r][2], c3 = lanes[r][3];
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		_mm_storeu_ps(out[0].rows[r], c0);
+		_mm_storeu_ps(out[1].rows[r], c1);
+		_mm_storeu_ps(out[2].rows[r], c2);
+		_mm_storeu_ps(out[3].rows[r], c3);
+	}
+}
+
+#define AFFINE_GATHER4(P, M) _mm_setr_ps(P[0].M, P[1].M, P[2].M, P[3].M)
+#endif
+
+#ifdef AFFINE_AVX2
+#define AFFINE_GATHER8(P, M) _mm256_setr_ps(P[0].M, P[1].M, P[2].M, P[3].M, P[4].M, P[5].M, P[6].M, P[7].M)
+#endif
+
+void make_affines(size_t count, glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales, Affine *out) {
+	size_t i = 0;
+
+	#ifdef AFFINE_AVX2
+	for (; i + 8 <= count; i += 8) {
+		glm::vec3 const *p = positions + i;
+		glm::quat const *q = rotations + i;
+		glm::vec3 const *s = scales + i;
+		TRS< Lanes8 > trs;
+		trs.px = AFFINE_GATHER8(p, x); trs.py = AFFINE_GATHER8(p, y); trs.pz = AFFINE_GATHER8(p, z);
+		trs.qx = AFFINE_GATHER8(q, x); trs.qy = AFFINE_GATHER8(q, y); trs.qz = AFFINE_GATHER8(q, z); trs.qw = AFFINE_GATHER8(q, w);
+		trs.sx = AFFINE_GATHER8(s, x); trs.sy = AFFINE_GATHER8(s, y); trs.sz = AFFINE_GATHER8(s, z);
+		__m256 lanes[3][4];
+		trs.compose(lanes);
+		__m128 lo[3][4], hi[3][4];
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 4; ++c) {
+				lo[r][c] = _mm256_castps256_ps128(lanes[r][c]);
+				hi[r][c] = _mm256_extractf128_ps(lanes[r][c], 1);
+			}
+		}
+		store4(lo, out + i);
+		store4(hi, out + i + 4);
+	}
+	#endif
+
+	#ifdef AFFINE_SSE
+	for (; i + 4 <= count; i += 4) {
+		glm::vec3 const *p = positions + i;
+		glm::quat const *q = rotations + i;
+		glm::vec3 const *s = scales + i;
+		TRS< Lanes4 > trs;
+		trs.px = AFFINE_GATHER4(p, x); trs.py = AFFINE_GATHER4(p, y); trs.pz = AFFINE_GATHER4(p, z);
+		trs.qx = AFFINE_GATHER4(q, x); trs.qy = AFFINE_GATHER4(q, y); trs.qz = AFFINE_GATHER4(q, z); trs.qw = AFFINE_GATHER4(q, w);
+		trs.sx = AFFINE_GATHER4(s, x); trs.sy = AFFINE_GATHER4(s, y); trs.sz = AFFINE_GATHER4(s, z);
+		__m128 lanes[3][4];
+		trs.compose(lanes);
+		store4(lanes, out + i);
+	}
+	#endif
+
+	for (; i < count; ++i) {
+		out[i] = make_affine(positions[i], rotations[i], scales[i]);
+	}
+}
+
+Affine make_affine(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	TRS< Lanes1 > trs;
+	trs.px = position.x; trs.py = position.y; trs.pz = position.z;
+	trs.qx = rotation.x; trs.qy = rotation.y; trs.qz = rotation.z; trs.qw = rotation.w;
+	trs.sx = scale.x; trs.sy = scale.y; trs.sz = scale.z;
+	Affine ret;
+	trs.compose(ret.rows);
+	return ret;
+}
+
+Affine make_inverse_affine(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	glm::vec3 inv_scale;
+	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
+	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
+	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
+
+	//rotation part with unit scale; the inverse is its transpose, then scaled by rows:
+	Affine r = make_affine(glm::vec3(0.0f), rotation, glm::vec3(1.0f));
+
+	Affine ret;
+	for (int row = 0; row < 3; ++row) {
+		float s = inv_scale[row];
+		ret.rows[row][0] = r.rows[0][row] * s;
+		ret.rows[row][1] = r.rows[1][row] * s;
+		ret.rows[row][2] = r.rows[2][row] * s;
+		ret.rows[row][3] = -(ret.rows[row][0] * position.x + ret.rows[row][1] * position.y + ret.rows[row][2] * position.z);
+	}
+	return ret;
+}
+
+//---------------------------
+
+Affine multiply(Affine const &a, Affine const &b) {
+	Affine ret;
+	#if defined(AFFINE_SSE)
+	__m128 b0 = _mm_loadu_ps(b.rows[0]);
+	__m128 b1 = _mm_loadu_ps(b.rows[1]);
+	__m128 b2 = _mm_loadu_ps(b.rows[2]);
+	__m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+	int row = 0;
+	#if defined(AFFINE_AVX2)
+	{ //first two rows in one go:
+		__m256 a01 = _mm256_loadu_ps(a.rows[0]);
+		__m256 B0 = _mm256_broadcast_ps(reinterpret_cast< __m128 const * >(b.rows[0]));
+		__m256 B1 = _mm256_broadcast_ps(reinterpret_cast< __m128 const * >(b.rows[1]));
+		__m256 B2 = _mm256_broadcast_ps(reinterpret_cast< __m128 const * >(b.rows[2]));
+		__m256 r = _mm256_and_ps(a01, _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1)));
+		#ifdef __FMA__
+		r = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(0,0,0,0)), B0, r);
+		r = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(1,1,1,1)), B1, r);
+		r = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(2,2,2,2)), B2, r);
+		#else
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(0,0,0,0)), B0));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(1,1,1,1)), B1));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(2,2,2,2)), B2));
+		#endif
+		_mm256_storeu_ps(ret.rows[0], r);
+		row = 2;
+	}
+	#endif
+	for (; row < 3; ++row) {
+		//row of a * b, plus a's translation:
+		__m128 ar = _mm_loadu_ps(a.rows[row]);
+		__m128 r = _mm_and_ps(ar, w_mask);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(0,0,0,0)), b0));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(1,1,1,1)), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(2,2,2,2)), b2));
+		_mm_storeu_ps(ret.rows[row], r);
+	}
+	#else
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 4; ++col) {
+			ret.rows[row][col] =
+				  a.rows[row][0] * b.rows[0][col]
+				+ a.rows[row][1] * b.rows[1][col]
+				+ a.rows[row][2] * b.rows[2][col];
+		}
+		ret.rows[row][3] += a.rows[row][3];
+	}
+	#endif
+	return ret;
+}
+
+#ifdef AFFINE_SSE
+template< int J >
+static inline __m128 mat4_times_affine_column(__m128 const m[4], __m128 const b[3]) {
+	__m128 r = _mm_mul_ps(m[0], _mm_shuffle_ps(b[0], b[0], _MM_SHUFFLE(J,J,J,J)));
+	r = _mm_add_ps(r, _mm_mul_ps(m[1], _mm_shuffle_ps(b[1], b[1], _MM_SHUFFLE(J,J,J,J))));
+	r = _mm_add_ps(r, _mm_mul_ps(m[2], _mm_shuffle_ps(b[2], b[2], _MM_SHUFFLE(J,J,J,J))));
+	return r;
+}
+#endif
+
+glm::mat4 multiply(glm::mat4 const &a, Affine const &b) {
+	glm::mat4 ret;
+	#ifdef AFFINE_SSE
+	float const *pa = glm::value_ptr(a);
+	float *pr = glm::value_ptr(ret);
+	__m128 m[4] = { _mm_loadu_ps(pa), _mm_loadu_ps(pa + 4), _mm_loadu_ps(pa + 8), _mm_loadu_ps(pa + 12) };
+	__m128 rows[3] = { _mm_loadu_ps(b.rows[0]), _mm_loadu_ps(b.rows[1]), _mm_loadu_ps(b.rows[2]) };
+	_mm_storeu_ps(pr, mat4_times_affine_column< 0 >(m, rows));
+	_mm_storeu_ps(pr + 4, mat4_times_affine_column< 1 >(m, rows));
+	_mm_storeu_ps(pr + 8, mat4_times_affine_column< 2 >(m, rows));
+	_mm_storeu_ps(pr + 12, _mm_add_ps(mat4_times_affine_column< 3 >(m, rows), m[3]));
+	#else
+	for (int col = 0; col < 4; ++col) {
+		ret[col] = a[0] * b.rows[0][col] + a[1] * b.rows[1][col] + a[2] * b.rows[2][col];
+	}
+	ret[3] += a[3];
+	#endif
+	return ret;
+}
+
+//---------------------------
+
+//the linear part of 'inverse' is already filled in; apply it to a's (negated) translation:
+static inline void invert_translation(Affine const &a, Affine *inverse) {
+	for (int row = 0; row < 3; ++row) {
+		float const *r = inverse->rows[row];
+		inverse->rows[row][3] = -(r[0] * a.rows[0][3] + r[1] * a.rows[1][3] + r[2] * a.rows[2][3]);
+	}
+}
+
+//cofactors of the upper-left 3x3: cof[r][c] is the cofactor of element (r, c):
+static inline float cofactors(Affine const &a, float cof[3][3]) {
+	float const (&m)[3][4] = a.rows;
+	cof[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	cof[0][1] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	cof[0][2] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	cof[1][0] = m[2][1] * m[0][2] - m[2][2] * m[0][1];
+	cof[1][1] = m[2][2] * m[0][0] - m[2][0] * m[0][2];
+	cof[1][2] = m[2][0] * m[0][1] - m[2][1] * m[0][0];
+	cof[2][0] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	cof[2][1] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	cof[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+	float det = m[0][0] * cof[0][0] + m[0][1] * cof[0][1] + m[0][2] * cof[0][2];
+	return (det == 0.0f ? 0.0f : 1.0f / det);
+}
+
+//squared length of the first column (the scale, squared, if a is a similarity):
+static inline float inverse_scale2(Affine const &a) {
+	float scale2 = a.rows[0][0] * a.rows[0][0] + a.rows[1][0] * a.rows[1][0] + a.rows[2][0] * a.rows[2][0];
+	return (scale2 == 0.0f ? 0.0f : 1.0f / scale2);
+}
+
+Affine invert(Affine const &a) {
+	//inverse is the transposed cofactor matrix over the determinant:
+	float cof[3][3];
+	float inv_det = cofactors(a, cof);
+	Affine ret;
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 3; ++col) {
+			ret.rows[row][col] = cof[col][row] * inv_det;
+		}
+	}
+	invert_translation(a, &ret);
+	return ret;
+}
+
+Affine invert_similarity(Affine const &a) {
+	float inv_scale2 = inverse_scale2(a);
+	Affine ret;
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 3; ++col) {
+			ret.rows[row][col] = a.rows[col][row] * inv_scale2;
+		}
+	}
+	invert_translation(a, &ret);
+	return ret;
+}
+
+glm::mat3 normal_matrix(Affine const &a) {
+	//inverse transpose is the cofactor matrix over the determinant:
+	float cof[3][3];
+	float inv_det = cofactors(a, cof);
+	return glm::mat3(
+		glm::vec3(cof[0][0], cof[1][0], cof[2][0]) * inv_det,
+		glm::vec3(cof[0][1], cof[1][1], cof[2][1]) * inv_det,
+		glm::vec3(cof[0][2], cof[1][2], cof[2][2]) * inv_det
+	);
+}
+
+glm::mat3 normal_matrix_similarity(Affine const &a) {
+	//for M = s * R, inverse(transpose(M)) = R / s = M / s^2:
+	float inv_scale2 = inverse_scale2(a);
+	return glm::mat3(
+		glm::vec3(a.rows[0][0], a.rows[1][0], a.rows[2][0]) * inv_scale2,
+		glm::vec3(a.rows[0][1], a.rows[1][1], a.rows[2][1]) * inv_scale2,
+		glm::vec3(a.rows[0][2], a.rows[1][2], a.rows[2][2]) * inv_scale2
+	);
+}
+
+//---------------------------
+
+glm::mat4 to_mat4(Affine const &a) {
+	glm::mat4 ret;
+	#ifdef AFFINE_SSE
+	__m128 c0 = _mm_loadu_ps(a.rows[0]);
+	__m128 c1 = _mm_loadu_ps(a.rows[1]);
+	__m128 c2 = _mm_loadu_ps(a.rows[2]);
+	__m128 c3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	float *pr = glm::value_ptr(ret);
+	_mm_storeu_ps(pr, c0);
+	_mm_storeu_ps(pr + 4, c1);
+	_mm_storeu_ps(pr + 8, c2);
+	_mm_storeu_ps(pr + 12, c3);
+	#else
+	for (int col = 0; col < 4; ++col) {
+		ret[col] = glm::vec4(a.rows[0][col], a.rows[1][col], a.rows[2][col], (col == 3 ? 1.0f : 0.0f));
+	}
+	#endif
+	return ret;
+}
+
+glm::mat3 to_mat3(Affine const &a) {
+	return glm::mat3(
+		glm::vec3(a.rows[0][0], a.rows[1][0], a.rows[2][0]),
+		glm::vec3(a.rows[0][1], a.rows[1][1], a.rows[2][1]),
+		glm::vec3(a.rows[0][2], a.rows[1][2], a.rows[2][2])
+	);
+}
+
+Affine to_affine(glm::mat4 const &m) {
+	Affine ret;
+	#ifdef AFFINE_SSE
+	float const *pm = glm::value_ptr(m);
+	__m128 r0 = _mm_loadu_ps(pm);
+	__m128 r1 = _mm_loadu_ps(pm + 4);
+	__m128 r2 = _mm_loadu_ps(pm + 8);
+	__m128 r3 = _mm_loadu_ps(pm + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(ret.rows[0], r0);
+	_mm_storeu_ps(ret.rows[1], r1);
+	_mm_storeu_ps(ret.rows[2], r2);
+	#else
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 4; ++col) {
+			ret.rows[row][col] = m[col][row];
+		}
+	}
+	#endif
+	return ret;
+}
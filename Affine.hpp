@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+
+//Affine is the top three rows of a 4x4 transformation whose last row is (0,0,0,1),
+// stored row-major so that each row fits in one SSE register.
+//The functions below use SSE (or AVX2, when compiled with -mavx2) with a scalar fallback.
+
+struct alignas(16) Affine {
+	float rows[3][4];
+};
+
+//translate * rotate * scale, built directly (no intermediate 4x4 matrices):
+Affine make_affine(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+
+//inverse of the above (un-scale * un-rotate * un-translate):
+// note: assumes 'rotation' is normalized; zero scales invert to zero.
+Affine make_inverse_affine(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+
+//make_affine for 'count' records at once:
+void make_affines(size_t count, glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales, Affine *out);
+
+//a * b:
+Affine multiply(Affine const &a, Affine const &b);
+//a * b, for a general (e.g., projective) a:
+glm::mat4 multiply(glm::mat4 const &a, Affine const &b);
+
+//inverse of a general (invertible) a, from cofactors:
+// note: singular matrices invert to zero.
+Affine invert(Affine const &a);
+//inverse of an a whose upper-left 3x3 is a rotation times a uniform scale (a "similarity"),
+// which is just that 3x3 transposed over the squared scale:
+Affine invert_similarity(Affine const &a);
+
+//inverse transpose of the upper-left 3x3 (for transforming normals), from cofactors:
+glm::mat3 normal_matrix(Affine const &a);
+//same, for a similarity, where it is just the 3x3 over the squared scale:
+glm::mat3 normal_matrix_similarity(Affine const &a);
+
+//conversions:
+glm::mat4 to_mat4(Affine const &a);
+glm::mat3 to_mat3(Affine const &a); //upper-left 3x3
+Affine to_affine(glm::mat4 const &m); //drops the last row
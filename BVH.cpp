@@ -0,0 +1,508 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+static BVH::Box empty_box() {
+	BVH::Box box;
+	box.min = glm::vec3( std::numeric_limits< float >::infinity());
+	box.max = glm::vec3(-std::numeric_limits< float >::infinity());
+	return box;
+}
+
+static BVH::Box merge(BVH::Box const &a, BVH::Box const &b) {
+	BVH::Box box;
+	box.min = glm::min(a.min, b.min);
+	box.max = glm::max(a.max, b.max);
+	return box;
+}
+
+//(half) surface area, which is all the SAH needs:
+static float area(BVH::Box const &box) {
+	glm::vec3 d = box.max - box.min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static bool contains(BVH::Box const &outer, BVH::Box const &inner) {
+	return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+	    && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+static bool overlaps(BVH::Box const &a, BVH::Box const &b) {
+	return a.min.x <= b.max.x && b.min.x <= a.max.x
+	    && a.min.y <= b.max.y && b.min.y <= a.max.y
+	    && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+static bool same(BVH::Box const &a, BVH::Box const &b) {
+	return a.min == b.min && a.max == b.max;
+}
+
+static glm::vec3 center(BVH::Box const &box) {
+	return 0.5f * (box.min + box.max);
+}
+
+//---------------------------
+
+uint32_t BVH::alloc_node() {
+	if (free_node != -1U) {
+		uint32_t node = free_node;
+		free_node = nodes[node].value;
+		nodes[node] = Node();
+		return node;
+	}
+	nodes.emplace_back();
+	return uint32_t(nodes.size()) - 1;
+}
+
+void BVH::free_node_at(uint32_t node) {
+	nodes[node] = Node();
+	nodes[node].value = free_node;
+	free_node = node;
+}
+
+void BVH::clear() {
+	nodes.clear();
+	root = -1U;
+	free_node = -1U;
+	leaf_count = 0;
+	internal_area = 0.0;
+	moved.clear();
+}
+
+uint32_t BVH::insert(Box const &box, uint32_t value) {
+	uint32_t leaf = alloc_node();
+	nodes[leaf].box.min = box.min - glm::vec3(margin);
+	nodes[leaf].box.max = box.max + glm::vec3(margin);
+	nodes[leaf].value = value;
+	++leaf_count;
+
+	if (root == -1U) {
+		root = leaf;
+		return leaf;
+	}
+
+	//walk down to the best sibling for the new leaf, always taking the cheaper child:
+	Box const leaf_box = nodes[leaf].box;
+	uint32_t sibling = root;
+	while (nodes[sibling].left != -1U) {
+		Node const &node = nodes[sibling];
+		float combined_area = area(merge(node.box, leaf_box));
+		//cost of pairing the leaf with 'node' right here:
+		float cost = 2.0f * combined_area;
+		//...and the least it can cost to go further down (this node grows either way):
+		float inherited = 2.0f * (combined_area - area(node.box));
+		auto descend_cost = [&](uint32_t child) {
+			float grown = area(merge(nodes[child].box, leaf_box));
+			if (nodes[child].left != -1U) grown -= area(nodes[child].box);
+			return grown + inherited;
+		};
+		float cost_left = descend_cost(node.left);
+		float cost_right = descend_cost(node.right);
+		if (cost < cost_left && cost < cost_right) break;
+		sibling = (cost_left < cost_right ? node.left : node.right);
+	}
+
+	//new parent for sibling + leaf:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t parent = alloc_node();
+	nodes[parent].box = merge(nodes[sibling].box, leaf_box);
+	internal_area += area(nodes[parent].box);
+	nodes[parent].parent = old_parent;
+	nodes[parent].left = sibling;
+	nodes[parent].right = leaf;
+	nodes[sibling].parent = parent;
+	nodes[leaf].parent = parent;
+	if (old_parent == -1U) {
+		root = parent;
+	} else if (nodes[old_parent].left == sibling) {
+		nodes[old_parent].left = parent;
+	} else {
+		nodes[old_parent].right = parent;
+	}
+
+	refit_from(old_parent);
+	return leaf;
+}
+
+void BVH::remove(uint32_t leaf) {
+	assert(leaf < nodes.size() && nodes[leaf].left == -1U);
+	uint32_t parent = nodes[leaf].parent;
+	free_node_at(leaf);
+	--leaf_count;
+
+	if (parent == -1U) {
+		assert(root == leaf);
+		root = -1U;
+		return;
+	}
+
+	//sibling takes the parent's place:
+	uint32_t sibling = (nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left);
+	uint32_t grandparent = nodes[parent].parent;
+	nodes[sibling].parent = grandparent;
+	if (grandparent == -1U) {
+		root = sibling;
+	} else if (nodes[grandparent].left == parent) {
+		nodes[grandparent].left = sibling;
+	} else {
+		nodes[grandparent].right = sibling;
+	}
+	internal_area -= area(nodes[parent].box);
+	free_node_at(parent);
+
+	refit_from(grandparent);
+}
+
+bool BVH::update(uint32_t leaf, Box const &box) {
+	assert(leaf < nodes.size() && nodes[leaf].left == -1U);
+	Node &node = nodes[leaf];
+	if (contains(node.box, box)) return false;
+	node.box.min = box.min - glm::vec3(margin);
+	node.box.max = box.max + glm::vec3(margin);
+	moved.emplace_back(leaf);
+	return true;
+}
+
+void BVH::refit() {
+	//all moved leaves already have their new boxes, so each walk up can stop
+	// as soon as it reaches a box that doesn't change:
+	// (leaves removed since their update() have no parent, so are skipped)
+	for (auto leaf : moved) {
+		refit_from(nodes[leaf].parent);
+	}
+	moved.clear();
+}
+
+void BVH::refit_from(uint32_t node) {
+	while (node != -1U) {
+		Box old_box = nodes[node].box;
+		rotate(node);
+		nodes[node].box = merge(nodes[nodes[node].left].box, nodes[nodes[node].right].box);
+		if (same(old_box, nodes[node].box)) break;
+		internal_area += double(area(nodes[node].box)) - double(area(old_box));
+		node = nodes[node].parent;
+	}
+}
+
+void BVH::rotate(uint32_t node) {
+	//consider swapping one child of 'node' with a child of the other one ("tree rotation"),
+	// which changes only the box of the other child -- so pick the swap that shrinks it most:
+	uint32_t best_child = -1U;
+	uint32_t best_grandchild = -1U;
+	float best_gain = 0.0f;
+	auto consider = [&](uint32_t child, uint32_t other) {
+		Node const &o = nodes[other];
+		if (o.left == -1U) return;
+		float other_area = area(o.box);
+		//child <-> o.left leaves 'other' holding child + o.right, and vice versa:
+		float gain = other_area - area(merge(nodes[child].box, nodes[o.right].box));
+		if (gain > best_gain) {
+			best_gain = gain;
+			best_child = child;
+			best_grandchild = o.left;
+		}
+		gain = other_area - area(merge(nodes[o.left].box, nodes[child].box));
+		if (gain > best_gain) {
+			best_gain = gain;
+			best_child = child;
+			best_grandchild = o.right;
+		}
+	};
+	consider(nodes[node].left, nodes[node].right);
+	consider(nodes[node].right, nodes[node].left);
+	if (best_child == -1U) return;
+
+	uint32_t other = nodes[best_grandchild].parent;
+	if (nodes[node].left == best_child) nodes[node].left = best_grandchild;
+	else nodes[node].right = best_grandchild;
+	if (nodes[other].left == best_grandchild) nodes[other].left = best_child;
+	else nodes[other].right = best_child;
+	nodes[best_grandchild].parent = node;
+	nodes[best_child].parent = other;
+	float old_area = area(nodes[other].box);
+	nodes[other].box = merge(nodes[nodes[other].left].box, nodes[nodes[other].right].box);
+	internal_area += double(area(nodes[other].box)) - double(old_area);
+}
+
+void BVH::build() {
+	moved.clear();
+	if (root == -1U) return;
+
+	//gather leaves, freeing internal nodes along the way:
+	scratch.clear();
+	std::vector< uint32_t > stack(1, root);
+	while (!stack.empty()) {
+		uint32_t node = stack.back();
+		stack.pop_back();
+		if (nodes[node].left == -1U) {
+			scratch.emplace_back(node);
+		} else {
+			stack.emplace_back(nodes[node].left);
+			stack.emplace_back(nodes[node].right);
+			free_node_at(node);
+		}
+	}
+
+	internal_area = 0.0; //(build_range() adds up the new internal nodes)
+	root = build_range(0, uint32_t(scratch.size()), 0);
+	nodes[root].parent = -1U;
+}
+
+uint32_t BVH::build_range(uint32_t begin, uint32_t end, uint32_t depth) {
+	if (end - begin == 1) return scratch[begin];
+
+	//split along the longest axis of the leaf centers:
+	Box bounds = empty_box();
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::vec3 c = center(nodes[scratch[i]].box);
+		bounds.min = glm::min(bounds.min, c);
+		bounds.max = glm::max(bounds.max, c);
+	}
+	glm::vec3 extent = bounds.max - bounds.min;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	uint32_t mid = begin;
+	const uint32_t MaxSAHDepth = 48;
+	if (extent[axis] > 0.0f && depth < MaxSAHDepth) {
+		//binned SAH: drop leaf centers in equal-width bins and try a split between each pair:
+		const uint32_t Bins = 16;
+		float scale = float(Bins) / extent[axis];
+		float offset = bounds.min[axis];
+		auto bin_of = [&](uint32_t leaf) {
+			return std::min(uint32_t((center(nodes[leaf].box)[axis] - offset) * scale), Bins - 1);
+		};
+		Box bin_boxes[Bins];
+		uint32_t bin_counts[Bins];
+		for (uint32_t b = 0; b < Bins; ++b) {
+			bin_boxes[b] = empty_box();
+			bin_counts[b] = 0;
+		}
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t b = bin_of(scratch[i]);
+			bin_boxes[b] = merge(bin_boxes[b], nodes[scratch[i]].box);
+			bin_counts[b] += 1;
+		}
+
+		//right-hand costs (for splitting before bin b):
+		float right_costs[Bins];
+		Box accum = empty_box();
+		uint32_t count = 0;
+		for (uint32_t b = Bins - 1; b > 0; --b) {
+			accum = merge(accum, bin_boxes[b]);
+			count += bin_counts[b];
+			right_costs[b] = (count ? area(accum) * float(count) : 0.0f);
+		}
+
+		uint32_t best_split = 0;
+		float best_cost = std::numeric_limits< float >::infinity();
+		accum = empty_box();
+		count = 0;
+		for (uint32_t b = 1; b < Bins; ++b) {
+			accum = merge(accum, bin_boxes[b - 1]);
+			count += bin_counts[b - 1];
+			if (count == 0 || count == end - begin) continue;
+			float cost = area(accum) * float(count) + right_costs[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		if (best_split != 0) {
+			mid = uint32_t(std::partition(scratch.begin() + begin, scratch.begin() + end, [&](uint32_t leaf) {
+				return bin_of(leaf) < best_split;
+			}) - scratch.begin());
+		}
+	}
+
+	if (mid == begin || mid == end) {
+		//all centers in one spot (or too deep), so just split in half:
+		mid = (begin + end) / 2;
+		std::nth_element(scratch.begin() + begin, scratch.begin() + mid, scratch.begin() + end, [&](uint32_t a, uint32_t b) {
+			return center(nodes[a].box)[axis] < center(nodes[b].box)[axis];
+		});
+	}
+
+	uint32_t left = build_range(begin, mid, depth + 1);
+	uint32_t right = build_range(mid, end, depth + 1);
+	uint32_t node = alloc_node();
+	nodes[node].box = merge(nodes[left].box, nodes[right].box);
+	internal_area += area(nodes[node].box);
+	nodes[node].left = left;
+	nodes[node].right = right;
+	nodes[left].parent = node;
+	nodes[right].parent = node;
+	return node;
+}
+
+//---------------------------
+
+void BVH::query(Box const &box, std::vector< uint32_t > *leaves) const {
+	assert(leaves);
+	if (root == -1U) return;
+	std::vector< uint32_t > stack(1, root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		uint32_t index = stack.back();
+		stack.pop_back();
+		if (!overlaps(node.box, box)) continue;
+		if (node.left == -1U) {
+			leaves->emplace_back(index);
+		} else {
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+}
+
+void BVH::query(glm::vec3 const &center, float radius, std::vector< uint32_t > *leaves) const {
+	assert(leaves);
+	if (root == -1U) return;
+	float radius2 = radius * radius;
+	std::vector< uint32_t > stack(1, root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		uint32_t index = stack.back();
+		stack.pop_back();
+		glm::vec3 d = glm::max(node.box.min - center, glm::max(glm::vec3(0.0f), center - node.box.max));
+		if (glm::dot(d, d) > radius2) continue;
+		if (node.left == -1U) {
+			leaves->emplace_back(index);
+		} else {
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+}
+
+void BVH::query(Frustum const &frustum, std::vector< uint32_t > *leaves) const {
+	assert(leaves);
+	if (root == -1U) return;
+	//each entry carries a mask of the planes its box still straddles;
+	// once a box is inside every plane, its whole subtree is reported without further tests:
+	struct Entry {
+		uint32_t node;
+		uint32_t planes;
+	};
+	std::vector< Entry > stack;
+	stack.push_back(Entry{root, (1U << 6) - 1});
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		Node const &node = nodes[entry.node];
+		bool outside = false;
+		for (uint32_t p = 0; p < 6; ++p) {
+			if (!(entry.planes & (1U << p))) continue;
+			glm::vec4 const &plane = frustum.planes[p];
+			//box corners farthest along / against the plane normal:
+			glm::vec3 far_corner(
+				plane.x >= 0.0f ? node.box.max.x : node.box.min.x,
+				plane.y >= 0.0f ? node.box.max.y : node.box.min.y,
+				plane.z >= 0.0f ? node.box.max.z : node.box.min.z);
+			glm::vec3 near_corner(
+				plane.x >= 0.0f ? node.box.min.x : node.box.max.x,
+				plane.y >= 0.0f ? node.box.min.y : node.box.max.y,
+				plane.z >= 0.0f ? node.box.min.z : node.box.max.z);
+			if (plane.x * far_corner.x + plane.y * far_corner.y + plane.z * far_corner.z + plane.w < 0.0f) {
+				outside = true;
+				break;
+			}
+			if (plane.x * near_corner.x + plane.y * near_corner.y + plane.z * near_corner.z + plane.w >= 0.0f) {
+				entry.planes &= ~(1U << p);
+			}
+		}
+		if (outside) continue;
+		if (node.left == -1U) {
+			leaves->emplace_back(entry.node);
+		} else {
+			stack.push_back(Entry{node.left, entry.planes});
+			stack.push_back(Entry{node.right, entry.planes});
+		}
+	}
+}
+
+void BVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< uint32_t > *leaves) const {
+	assert(leaves);
+	if (root == -1U) return;
+	glm::vec3 inv_direction;
+	for (int c = 0; c < 3; ++c) {
+		inv_direction[c] = (direction[c] != 0.0f ? 1.0f / direction[c] : 0.0f);
+	}
+	//slab test:
+	auto hits = [&](Box const &box) {
+		float t_min = 0.0f;
+		float t_max = max_t;
+		for (int c = 0; c < 3; ++c) {
+			if (direction[c] == 0.0f) {
+				if (origin[c] < box.min[c] || origin[c] > box.max[c]) return false;
+				continue;
+			}
+			float t0 = (box.min[c] - origin[c]) * inv_direction[c];
+			float t1 = (box.max[c] - origin[c]) * inv_direction[c];
+			if (t0 > t1) std::swap(t0, t1);
+			t_min = std::max(t_min, t0);
+			t_max = std::min(t_max, t1);
+			if (t_min > t_max) return false;
+		}
+		return true;
+	};
+	std::vector< uint32_t > stack(1, root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		uint32_t index = stack.back();
+		stack.pop_back();
+		if (!hits(node.box)) continue;
+		if (node.left == -1U) {
+			leaves->emplace_back(index);
+		} else {
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+}
+
+//---------------------------
+
+float BVH::cost() const {
+	if (root == -1U || nodes[root].left == -1U) return 0.0f;
+	float root_area = area(nodes[root].box);
+	return (root_area > 0.0f ? float(internal_area / root_area) : 0.0f);
+}
+
+void BVH::DEBUG_assert_valid() const {
+	if (root == -1U) {
+		assert(leaf_count == 0);
+		return;
+	}
+	assert(nodes[root].parent == -1U);
+	uint32_t leaves = 0;
+	double total_area = 0.0;
+	std::vector< uint32_t > stack(1, root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		uint32_t index = stack.back();
+		stack.pop_back();
+		if (node.left == -1U) {
+			++leaves;
+			continue;
+		}
+		total_area += area(node.box);
+		assert(nodes[node.left].parent == index);
+		assert(nodes[node.right].parent == index);
+		//(boxes above moved leaves are only fixed by refit())
+		assert(!moved.empty() || contains(node.box, nodes[node.left].box));
+		assert(!moved.empty() || contains(node.box, nodes[node.right].box));
+		stack.emplace_back(node.left);
+		stack.emplace_back(node.right);
+	}
+	assert(leaves == leaf_count);
+	//(the running total drifts a little with rounding)
+	assert(std::abs(total_area - internal_area) <= 1e-4 * std::max(1.0, total_area));
+	(void)leaves;
+	(void)total_area;
+}
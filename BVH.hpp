@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+//BVH is a dynamic bounding volume hierarchy: a binary tree of axis-aligned boxes
+// whose leaves each carry a 32-bit user value.
+// - insert() / remove() keep the tree valid incrementally;
+// - update() moves a leaf, and refit() then fixes up the boxes above every moved
+//   leaf, rotating nodes along the way to keep the tree tight;
+// - build() rebuilds the whole tree top-down using the surface area heuristic (SAH).
+//
+// Leaf boxes are padded by 'margin', so small motions don't need any update at all.
+// As a consequence, queries are conservative: they may report leaves up to 'margin'
+// away from the queried volume.
+//
+// Leaves are referred to by ids, which stay valid until the leaf is removed
+// (build() and rotations only move internal nodes around).
+
+struct BVH {
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	//padding added around leaf boxes:
+	float margin = 0.1f;
+
+	//add a leaf with a given box; returns its id:
+	uint32_t insert(Box const &box, uint32_t value);
+
+	//remove a leaf (its id may be re-used by later insert()s):
+	void remove(uint32_t leaf);
+
+	//change the box of a leaf; returns true if the tree needs a refit():
+	// (if 'box' still fits in the padded leaf box, nothing changes)
+	bool update(uint32_t leaf, Box const &box);
+
+	//bring internal boxes up to date after update()s:
+	// note: queries may miss moved leaves until this is called.
+	void refit();
+
+	//rebuild the tree from scratch (leaf ids are kept):
+	void build();
+
+	void clear();
+
+	uint32_t value(uint32_t leaf) const { return nodes[leaf].value; }
+	Box const &box(uint32_t leaf) const { return nodes[leaf].box; }
+	uint32_t size() const { return leaf_count; }
+
+	//queries append the ids of leaves whose (padded) boxes touch a volume:
+	void query(Box const &box, std::vector< uint32_t > *leaves) const;
+	void query(glm::vec3 const &center, float radius, std::vector< uint32_t > *leaves) const;
+	void query(Frustum const &frustum, std::vector< uint32_t > *leaves) const;
+	//boxes hit by the ray origin + t * direction for t in [0, max_t]:
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< uint32_t > *leaves) const;
+
+	//SAH cost of the tree (total surface area of internal nodes, relative to the root);
+	// lower is better, and is useful to decide when to build() again:
+	// (the total is kept up to date as boxes change, so this is O(1))
+	float cost() const;
+
+	//helper that checks parent/child links and box containment (slow):
+	void DEBUG_assert_valid() const;
+
+	//internals:
+	struct Node {
+		Box box;
+		uint32_t parent = -1U;
+		uint32_t left = -1U; //children, or -1U for leaves (and free nodes)
+		uint32_t right = -1U;
+		uint32_t value = 0; //user value for leaves (next free node for free nodes)
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	uint32_t free_node = -1U; //head of free list
+	uint32_t leaf_count = 0;
+	double internal_area = 0.0; //sum of internal nodes' areas (for cost())
+	std::vector< uint32_t > moved; //leaves update()'d since the last refit()
+	std::vector< uint32_t > scratch; //for build()
+
+	uint32_t alloc_node();
+	void free_node_at(uint32_t node);
+	//recompute boxes from 'node' up to the root (stopping early if nothing changes), with rotations:
+	void refit_from(uint32_t node);
+	//swap a child of 'node' with a grandchild if that makes the tree tighter:
+	void rotate(uint32_t node);
+	//build a subtree over leaves [begin, end) of 'scratch'; returns its root:
+	// (falls back to median splits below a certain depth, so the recursion stays shallow)
+	uint32_t build_range(uint32_t begin, uint32_t end, uint32_t depth);
+};
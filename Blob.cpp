@@ -0,0 +1,213 @@
+#include "Blob.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+//older blobs' chunk headers:
+struct OldChunkHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t size = 0;
+};
+static_assert(sizeof(OldChunkHeader) == 8, "header is packed");
+
+static void check_header(BlobHeader const &header, uint64_t blob_size) {
+	if (header.version != 2) {
+		throw std::runtime_error("Unsupported blob version " + std::to_string(header.version));
+	}
+	if (header.chunk_count > (blob_size - sizeof(BlobHeader)) / sizeof(BlobChunk)) {
+		throw std::runtime_error("Blob's table of contents doesn't fit in it");
+	}
+}
+
+static void check_toc(std::vector< BlobChunk > const &toc, uint64_t blob_size) {
+	uint64_t data_begin = sizeof(BlobHeader) + sizeof(BlobChunk) * toc.size();
+	for (auto const &chunk : toc) {
+		if (chunk.alignment == 0 || (chunk.alignment & (chunk.alignment - 1)) != 0 || chunk.offset % chunk.alignment != 0) {
+			throw std::runtime_error("Blob chunk has a bad alignment");
+		}
+		if (chunk.offset < data_begin || chunk.offset > blob_size || chunk.size > blob_size - chunk.offset) {
+			throw std::runtime_error("Blob chunk doesn't fit in the blob");
+		}
+	}
+}
+
+static BlobChunk old_chunk(OldChunkHeader const &header, uint64_t offset, uint64_t blob_size) {
+	BlobChunk chunk;
+	std::memcpy(chunk.magic, header.magic, 4);
+	chunk.offset = offset;
+	chunk.size = header.size;
+	if (chunk.offset > blob_size || chunk.size > blob_size - chunk.offset) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	return chunk;
+}
+
+void read_blob_toc(char const *begin, char const *end, std::vector< BlobChunk > *toc_) {
+	assert(begin <= end);
+	assert(toc_);
+	auto &toc = *toc_;
+	toc.clear();
+	uint64_t size = uint64_t(end - begin);
+
+	if (size >= sizeof(BlobHeader) && std::memcmp(begin, "blob", 4) == 0) {
+		BlobHeader header;
+		std::memcpy(&header, begin, sizeof(header));
+		check_header(header, size);
+		toc.resize(header.chunk_count);
+		std::memcpy(toc.data(), begin + sizeof(header), sizeof(BlobChunk) * toc.size());
+		check_toc(toc, size);
+	} else {
+		//older blob -- walk the chunk headers:
+		for (char const *at = begin; at != end; ) {
+			if (size_t(end - at) < sizeof(OldChunkHeader)) {
+				throw std::runtime_error("Failed to read chunk header");
+			}
+			OldChunkHeader header;
+			std::memcpy(&header, at, sizeof(header));
+			toc.emplace_back(old_chunk(header, uint64_t(at - begin) + sizeof(header), size));
+			at = begin + toc.back().offset + toc.back().size;
+		}
+	}
+}
+
+void read_blob_toc(std::istream &from, std::vector< BlobChunk > *toc_) {
+	assert(toc_);
+	auto &toc = *toc_;
+	toc.clear();
+
+	if (!from.seekg(0, std::ios::end)) {
+		throw std::runtime_error("Failed to read blob");
+	}
+	uint64_t size = uint64_t(from.tellg());
+	from.seekg(0);
+
+	BlobHeader header;
+	if (size >= sizeof(BlobHeader) && from.read(reinterpret_cast< char * >(&header), sizeof(header)) && std::memcmp(header.magic, "blob", 4) == 0) {
+		check_header(header, size);
+		toc.resize(header.chunk_count);
+		if (!from.read(reinterpret_cast< char * >(toc.data()), sizeof(BlobChunk) * toc.size())) {
+			throw std::runtime_error("Failed to read blob's table of contents");
+		}
+		check_toc(toc, size);
+	} else {
+		//older blob -- hop from chunk header to chunk header:
+		from.clear();
+		for (uint64_t at = 0; at != size; ) {
+			OldChunkHeader old;
+			if (!from.seekg(std::streamoff(at)) || !from.read(reinterpret_cast< char * >(&old), sizeof(old))) {
+				throw std::runtime_error("Failed to read chunk header");
+			}
+			toc.emplace_back(old_chunk(old, at + sizeof(old), size));
+			at = toc.back().offset + toc.back().size;
+		}
+	}
+}
+
+BlobChunk const *find_chunk(std::vector< BlobChunk > const &toc, std::string const &magic) {
+	for (auto const &chunk : toc) {
+		if (magic.size() == 4 && std::memcmp(chunk.magic, magic.data(), 4) == 0) return &chunk;
+	}
+	return nullptr;
+}
+
+//---------------------------
+
+//lookup tables for "slicing-by-8": table[k][b] is the CRC of byte b followed by k zero bytes:
+struct CRCTables {
+	uint32_t table[8][256];
+	CRCTables() {
+		for (uint32_t b = 0; b < 256; ++b) {
+			uint32_t crc = b;
+			for (uint32_t bit = 0; bit < 8; ++bit) {
+				crc = (crc & 1 ? 0xedb88320U ^ (crc >> 1) : crc >> 1);
+			}
+			table[0][b] = crc;
+		}
+		for (uint32_t b = 0; b < 256; ++b) {
+			for (uint32_t k = 1; k < 8; ++k) {
+				table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+			}
+		}
+	}
+};
+
+uint32_t blob_checksum(void const *data_, size_t size, uint32_t crc) {
+	static const CRCTables tables;
+	auto const &t = tables.table;
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+
+	crc = ~crc;
+	//eight bytes at a time (blobs -- and so this -- assume a little-endian machine):
+	for (; size >= 8; data += 8, size -= 8) {
+		uint32_t lo, hi;
+		std::memcpy(&lo, data, 4);
+		std::memcpy(&hi, data + 4, 4);
+		lo ^= crc;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+		    ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+	for (; size > 0; ++data, --size) {
+		crc = t[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+void check_chunk(BlobChunk const &chunk, void const *data) {
+	if ((chunk.flags & BlobChunk::HasChecksum) && blob_checksum(data, size_t(chunk.size)) != chunk.checksum) {
+		throw std::runtime_error("Checksum mismatch in '" + std::string(chunk.magic, 4) + "' chunk");
+	}
+}
+
+//---------------------------
+
+void BlobWriter::add(std::string const &magic, void const *data, size_t size, uint32_t alignment) {
+	if (magic.size() != 4) {
+		throw std::runtime_error("Chunk magic should be four characters");
+	}
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		throw std::runtime_error("Chunk alignment should be a power of two");
+	}
+	Pending pending;
+	std::memcpy(pending.chunk.magic, magic.data(), 4);
+	pending.chunk.alignment = alignment;
+	pending.chunk.size = size;
+	pending.data = data;
+	chunks.emplace_back(pending);
+}
+
+void BlobWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	//lay out the chunks after the table of contents:
+	BlobHeader header;
+	header.chunk_count = uint32_t(chunks.size());
+	std::vector< BlobChunk > toc;
+	uint64_t offset = sizeof(BlobHeader) + sizeof(BlobChunk) * chunks.size();
+	for (auto const &pending : chunks) {
+		BlobChunk chunk = pending.chunk;
+		offset = (offset + chunk.alignment - 1) / chunk.alignment * chunk.alignment;
+		chunk.offset = offset;
+		chunk.checksum = blob_checksum(pending.data, size_t(chunk.size));
+		chunk.flags = BlobChunk::HasChecksum;
+		toc.emplace_back(chunk);
+		offset += chunk.size;
+	}
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(toc.data()), sizeof(BlobChunk) * toc.size());
+	uint64_t at = sizeof(BlobHeader) + sizeof(BlobChunk) * toc.size();
+	for (uint32_t i = 0; i < toc.size(); ++i) {
+		static const char Zeros[64] = {0};
+		while (at < toc[i].offset) {
+			uint64_t padding = std::min< uint64_t >(sizeof(Zeros), toc[i].offset - at);
+			to.write(Zeros, std::streamsize(padding));
+			at += padding;
+		}
+		to.write(reinterpret_cast< char const * >(chunks[i].data), std::streamsize(toc[i].size));
+		at += toc[i].size;
+	}
+}
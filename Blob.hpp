@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//Blob files hold named chunks of data. Version 2 blobs are laid out as:
+// - a header (BlobHeader): "blob", the version, and how many chunks there are;
+// - a table of contents: one BlobChunk per chunk;
+// - the chunks' data, each at an offset that is a multiple of its alignment (zero padding between).
+// So readers can go straight to -- or map -- just the chunks they want, in any order, and find them aligned.
+//Older blobs are just chunks one after another, each an 8-byte header (magic, uint32_t size) and then its data;
+// read_blob_toc() builds the same table of contents for those by walking the headers.
+
+struct BlobHeader {
+	char magic[4] = {'b', 'l', 'o', 'b'};
+	uint32_t version = 2;
+	uint32_t chunk_count = 0;
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(BlobHeader) == 16, "BlobHeader is packed");
+
+struct BlobChunk {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t alignment = 1; //'offset' is a multiple of this (a power of two)
+	uint64_t offset = 0; //from the start of the file
+	uint64_t size = 0; //in bytes
+	uint32_t checksum = 0; //blob_checksum() of the data
+	uint32_t flags = 0;
+	enum : uint32_t {
+		HasChecksum = 1, //(chunks in older blobs don't have one)
+	};
+};
+static_assert(sizeof(BlobChunk) == 32, "BlobChunk is packed");
+
+//read the table of contents of a blob that is in memory (e.g., in a MappedFile):
+// note: will throw if the header or table is bad, or any chunk doesn't fit in the blob.
+void read_blob_toc(char const *begin, char const *end, std::vector< BlobChunk > *toc);
+//...or of a blob in a stream, whose chunks can then be read by seeking to them:
+void read_blob_toc(std::istream &from, std::vector< BlobChunk > *toc);
+
+//the (first) chunk with a given magic, or nullptr if there isn't one:
+BlobChunk const *find_chunk(std::vector< BlobChunk > const &toc, std::string const &magic);
+
+//CRC-32 (the one zlib and PNG use), continuing from 'crc' (pass 0 to start):
+uint32_t blob_checksum(void const *data, size_t size, uint32_t crc = 0);
+//note: will throw if the chunk has a checksum that 'data' doesn't match.
+void check_chunk(BlobChunk const &chunk, void const *data);
+
+//BlobWriter lists chunks (without copying their data, so it must stay put until write()) and writes them as a version 2 blob:
+struct BlobWriter {
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &data, uint32_t alignment = 16) {
+		add(magic, data.data(), data.size() * sizeof(T), alignment);
+	}
+	void add(std::string const &magic, void const *data, size_t size, uint32_t alignment = 16);
+	//(check the stream afterward to see if writing worked)
+	void write(std::ostream *to) const;
+
+	//internals:
+	struct Pending {
+		BlobChunk chunk; //(offset and checksum are filled in by write())
+		void const *data;
+	};
+	std::vector< Pending > chunks;
+};
@@ -0,0 +1,109 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(FRUSTUM_SSE) && defined(__AVX2__)
+#define FRUSTUM_AVX2 1
+#include <immintrin.h>
+#endif
+
+Frustum Frustum::from_matrix(glm::mat4 const &m) {
+	//rows of the matrix (glm is column-major):
+	glm::vec4 row[4];
+	for (int r = 0; r < 4; ++r) {
+		row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	}
+	Frustum ret;
+	ret.planes[0] = row[3] + row[0];
+	ret.planes[1] = row[3] - row[0];
+	ret.planes[2] = row[3] + row[1];
+	ret.planes[3] = row[3] - row[1];
+	ret.planes[4] = row[3] + row[2];
+	ret.planes[5] = row[3] - row[2];
+	for (auto &plane : ret.planes) {
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0.0f) plane /= length;
+	}
+	return ret;
+}
+
+bool Frustum::test_sphere(glm::vec3 const &center, float radius) const {
+	for (auto const &plane : planes) {
+		if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) return false;
+	}
+	return true;
+}
+
+void Frustum::test_spheres(size_t count, float const *x, float const *y, float const *z, float const *radius, uint8_t *visible) const {
+	size_t i = 0;
+
+	#ifdef FRUSTUM_AVX2
+	{
+		__m256 px[6], py[6], pz[6], pw[6];
+		for (int p = 0; p < 6; ++p) {
+			px[p] = _mm256_set1_ps(planes[p].x);
+			py[p] = _mm256_set1_ps(planes[p].y);
+			pz[p] = _mm256_set1_ps(planes[p].z);
+			pw[p] = _mm256_set1_ps(planes[p].w);
+		}
+		__m256 zero = _mm256_setzero_ps();
+		for (; i + 8 <= count; i += 8) {
+			__m256 cx = _mm256_loadu_ps(x + i);
+			__m256 cy = _mm256_loadu_ps(y + i);
+			__m256 cz = _mm256_loadu_ps(z + i);
+			__m256 neg_r = _mm256_sub_ps(zero, _mm256_loadu_ps(radius + i));
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; ++p) {
+				__m256 d = _mm256_add_ps(_mm256_mul_ps(px[p], cx), pw[p]);
+				d = _mm256_add_ps(d, _mm256_mul_ps(py[p], cy));
+				d = _mm256_add_ps(d, _mm256_mul_ps(pz[p], cz));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(inside);
+			for (int k = 0; k < 8; ++k) {
+				visible[i + k] = uint8_t((mask >> k) & 1);
+			}
+		}
+	}
+	#endif
+
+	#ifdef FRUSTUM_SSE
+	{
+		__m128 px[6], py[6], pz[6], pw[6];
+		for (int p = 0; p < 6; ++p) {
+			px[p] = _mm_set1_ps(planes[p].x);
+			py[p] = _mm_set1_ps(planes[p].y);
+			pz[p] = _mm_set1_ps(planes[p].z);
+			pw[p] = _mm_set1_ps(planes[p].w);
+		}
+		__m128 zero = _mm_setzero_ps();
+		for (; i + 4 <= count; i += 4) {
+			__m128 cx = _mm_loadu_ps(x + i);
+			__m128 cy = _mm_loadu_ps(y + i);
+			__m128 cz = _mm_loadu_ps(z + i);
+			__m128 neg_r = _mm_sub_ps(zero, _mm_loadu_ps(radius + i));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; ++p) {
+				__m128 d = _mm_add_ps(_mm_mul_ps(px[p], cx), pw[p]);
+				d = _mm_add_ps(d, _mm_mul_ps(py[p], cy));
+				d = _mm_add_ps(d, _mm_mul_ps(pz[p], cz));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+			}
+			int mask = _mm_movemask_ps(inside);
+			visible[i + 0] = uint8_t(mask & 1);
+			visible[i + 1] = uint8_t((mask >> 1) & 1);
+			visible[i + 2] = uint8_t((mask >> 2) & 1);
+			visible[i + 3] = uint8_t((mask >> 3) & 1);
+		}
+	}
+	#endif
+
+	for (; i < count; ++i) {
+		visible[i] = (test_sphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0);
+	}
+}
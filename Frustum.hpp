@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+//Frustum is the six planes of a view volume, as (normal, offset) with normals pointing inward:
+// a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+	glm::vec4 planes[6]; //left, right, bottom, top, near, far
+
+	//extract planes from a (world-to-clip) matrix:
+	// note: for infinite projections the far plane comes out as (0,0,0,+) and never culls.
+	static Frustum from_matrix(glm::mat4 const &world_to_clip);
+
+	//does the sphere touch the frustum?
+	bool test_sphere(glm::vec3 const &center, float radius) const;
+
+	//test 'count' spheres at once (SSE/AVX2 when available), given as separate arrays
+	// of center x/y/z and radius; writes 1 (visible) or 0 (culled) to 'visible':
+	void test_spheres(size_t count, float const *x, float const *y, float const *z, float const *radius, uint8_t *visible) const;
+};
@@ -0,0 +1,111 @@
+#include "GPUTimers.hpp"
+#include "Profiler.hpp"
+
+#include <cassert>
+#include <cstring>
+
+GPUTimers::~GPUTimers() {
+	release();
+}
+
+void GPUTimers::release() {
+	for (auto &frame : frames) {
+		for (auto const &pass : frame.passes) {
+			glDeleteQueries(1, &pass.begin);
+			glDeleteQueries(1, &pass.end);
+		}
+		frame.passes.clear();
+		frame.used = 0;
+	}
+	in_pass = false;
+}
+
+void GPUTimers::begin(char const *name) {
+	assert(!in_pass && "GPUTimers passes don't nest");
+	in_pass = true;
+
+	Frame &frame = frames[current];
+	if (frame.used == frame.passes.size()) {
+		frame.passes.emplace_back();
+		glGenQueries(1, &frame.passes.back().begin);
+		glGenQueries(1, &frame.passes.back().end);
+	}
+	Pass &pass = frame.passes[frame.used++];
+	pass.name = name;
+	glQueryCounter(pass.begin, GL_TIMESTAMP);
+}
+
+void GPUTimers::end() {
+	assert(in_pass && "GPUTimers::end without begin");
+	in_pass = false;
+
+	Frame &frame = frames[current];
+	glQueryCounter(frame.passes[frame.used - 1].end, GL_TIMESTAMP);
+}
+
+void GPUTimers::frame() {
+	assert(!in_pass && "GPUTimers::frame inside a pass");
+
+	if (!calibrated) {
+		//line up the GPU's clock with the profiler's, so passes land in the right place in traces:
+		// (reading GL_TIMESTAMP directly doesn't wait for queued commands)
+		GLint64 gpu_now = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+		gpu_to_cpu = int64_t(Profiler::now()) - int64_t(gpu_now);
+		calibrated = true;
+	}
+
+	current = (current + 1) % Latency;
+	collect(frames[current], false);
+}
+
+void GPUTimers::finish() {
+	assert(!in_pass && "GPUTimers::finish inside a pass");
+	//oldest first:
+	for (uint32_t i = 1; i <= Latency; ++i) {
+		collect(frames[(current + i) % Latency], true);
+	}
+}
+
+void GPUTimers::collect(Frame &frame, bool wait) {
+	if (frame.used == 0) return;
+
+	//this frame's queries are about to be reused, so its results are now or never:
+	GLuint available = 0;
+	if (wait) available = 1; //(GL_QUERY_RESULT blocks until it is)
+	else glGetQueryObjectuiv(frame.passes[frame.used - 1].end, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		++dropped;
+		frame.used = 0;
+		return;
+	}
+
+	for (uint32_t p = 0; p < frame.used; ++p) {
+		Pass const &pass = frame.passes[p];
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(pass.begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(pass.end, GL_QUERY_RESULT, &end);
+		if (end < begin) end = begin;
+
+		Total *total = nullptr;
+		for (auto &t : totals) {
+			if (t.name == pass.name || std::strcmp(t.name, pass.name) == 0) {
+				total = &t;
+				break;
+			}
+		}
+		if (!total) {
+			totals.emplace_back();
+			total = &totals.back();
+			total->name = pass.name;
+		}
+		total->seconds += double(end - begin) * 1e-9;
+		total->count += 1;
+
+#ifndef PROFILER_DISABLED
+		static Profiler::Thread &track = Profiler::track("GPU");
+		Profiler::record(track, pass.name, uint64_t(int64_t(begin) + gpu_to_cpu), uint64_t(int64_t(end) + gpu_to_cpu));
+#endif
+	}
+	frame.used = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//GPUTimers measures how long the GPU spends on each pass of a frame, using GL_TIMESTAMP queries.
+// Results are read back a few frames later (never waiting on the GPU) and both
+// accumulated into per-pass totals and recorded on the profiler's "GPU" track.
+//
+//  timers.begin("scene"); scene.render(); timers.end();
+//  ...
+//  timers.frame(); //once per frame, after the last pass
+//
+//Needs a current OpenGL context while in use, and when destroyed unless release() was called first
+// (queries are only created once passes are timed, so it may be constructed before the context).
+
+struct GPUTimers {
+	GPUTimers() = default;
+	GPUTimers(GPUTimers const &) = delete;
+	GPUTimers &operator=(GPUTimers const &) = delete;
+	~GPUTimers(); //(calls release())
+
+	//delete all query objects (e.g., just before the context is destroyed):
+	void release();
+
+	//start/stop timing a pass (passes don't nest); 'name' must be a string literal:
+	void begin(char const *name);
+	void end();
+
+	//finish this frame's passes and collect results from the oldest frame in flight:
+	void frame();
+
+	//collect results from every frame in flight, waiting for the GPU if needed (e.g., before reporting at exit):
+	void finish();
+
+	//GPU time per pass since the last reset_totals() (in order of first appearance):
+	struct Total {
+		char const *name;
+		double seconds = 0.0;
+		uint32_t count = 0; //number of times the pass was timed
+	};
+	std::vector< Total > totals;
+	void reset_totals() { totals.clear(); }
+
+	//frames whose results were still pending when their queries had to be reused:
+	uint32_t dropped = 0;
+
+	//internals:
+	enum : uint32_t { Latency = 4 }; //frames in flight before results are read back
+	struct Pass {
+		char const *name;
+		GLuint begin = 0, end = 0; //timestamp queries
+	};
+	struct Frame {
+		std::vector< Pass > passes; //query objects are reused from frame to frame
+		uint32_t used = 0; //passes used this time around
+	};
+	Frame frames[Latency];
+	uint32_t current = 0;
+	bool in_pass = false;
+	bool calibrated = false;
+	int64_t gpu_to_cpu = 0; //(Profiler::now() - GL_TIMESTAMP) nanoseconds
+	void collect(Frame &frame, bool wait);
+};
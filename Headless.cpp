@@ -0,0 +1,104 @@
+#include "Headless.hpp"
+
+#include <cassert>
+
+#if defined(__linux__)
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+
+static bool has_extension(char const *extensions, char const *name) {
+	if (!extensions) return false;
+	size_t length = std::strlen(name);
+	for (char const *at = std::strstr(extensions, name); at; at = std::strstr(at + length, name)) {
+		if ((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0')) return true;
+	}
+	return false;
+}
+
+bool Headless::create(std::string *error) {
+	assert(error);
+	assert(display == nullptr && "create() should only be called once");
+
+	//prefer the surfaceless platform (needs no X server or GPU device node), if the driver has it:
+	EGLDisplay egl_display = EGL_NO_DISPLAY;
+	if (has_extension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_MESA_platform_surfaceless")) {
+		auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display) {
+			egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+	}
+	if (egl_display == EGL_NO_DISPLAY) {
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, nullptr, nullptr)) {
+		*error = "couldn't initialize an EGL display";
+		return false;
+	}
+	display = egl_display;
+
+	if (!has_extension(eglQueryString(egl_display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		*error = "EGL display doesn't support surfaceless contexts";
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		*error = "EGL doesn't support desktop OpenGL";
+		return false;
+	}
+
+	//(no surfaces will be made, so any surface type will do)
+	EGLint const config_attribs[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &configs) || configs == 0) {
+		*error = "no EGL config supports OpenGL";
+		return false;
+	}
+
+	//OpenGL 3.3 core, as for the windowed context:
+	EGLint const context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE
+	};
+	EGLContext egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+	if (egl_context == EGL_NO_CONTEXT) {
+		*error = "couldn't create an OpenGL 3.3 core context";
+		return false;
+	}
+	context = egl_context;
+
+	if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+		*error = "couldn't make the context current";
+		return false;
+	}
+	return true;
+}
+
+Headless::~Headless() {
+	if (display) {
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context) eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+}
+
+#else //not linux
+
+bool Headless::create(std::string *error) {
+	assert(error);
+	*error = "headless rendering is only supported on Linux";
+	return false;
+}
+
+Headless::~Headless() {
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+//Headless is an OpenGL 3.3 core context with no window (or display) behind it, for running
+// the renderer on machines without a display -- e.g., for benchmarks.
+// There is no default framebuffer, so bind a framebuffer object before drawing.
+//Only available on Linux (through EGL, preferably its "surfaceless" platform); elsewhere create() fails.
+
+struct Headless {
+	Headless() = default;
+	Headless(Headless const &) = delete;
+	~Headless();
+
+	//create the context and make it current:
+	// returns false (with a description in *error) on failure.
+	bool create(std::string *error);
+
+	//internals:
+	void *display = nullptr; //EGLDisplay
+	void *context = nullptr; //EGLContext
+};
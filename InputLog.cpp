@@ -0,0 +1,120 @@
+#include "InputLog.hpp"
+#include "read_chunk.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+void InputLog::record_event(SDL_Event const &evt) {
+	Event event;
+	event.type = evt.type;
+	event.state = 0;
+	event.x = event.y = 0;
+	event.sym = 0;
+	event.scancode = 0;
+	if (evt.type == SDL_MOUSEMOTION) {
+		event.state = evt.motion.state;
+		event.x = evt.motion.x;
+		event.y = evt.motion.y;
+	} else if (evt.type == SDL_KEYDOWN || evt.type == SDL_KEYUP) {
+		event.state = evt.key.repeat;
+		event.sym = evt.key.keysym.sym;
+		event.scancode = evt.key.keysym.scancode;
+	} else if (evt.type != SDL_QUIT) {
+		return;
+	}
+	events.emplace_back(event);
+}
+
+void InputLog::record_frame(Uint8 const *keyboard, float elapsed) {
+	for (uint32_t i = 0; i < SDL_NUM_SCANCODES; ++i) {
+		Uint8 down = (keyboard[i] ? 1 : 0);
+		if (down != state[i]) {
+			KeyChange change;
+			change.scancode = uint16_t(i);
+			change.down = down;
+			change.padding = 0;
+			keys.emplace_back(change);
+			state[i] = down;
+		}
+	}
+	Frame frame;
+	frame.elapsed = elapsed;
+	frame.events_end = uint32_t(events.size());
+	frame.keys_end = uint32_t(keys.size());
+	frames.emplace_back(frame);
+}
+
+void InputLog::save(std::string const &filename) const {
+	BlobWriter blob;
+	blob.add("inp0", frames);
+	blob.add("evt0", events);
+	blob.add("key0", keys);
+	std::ofstream file(filename, std::ios::binary);
+	blob.write(&file);
+	if (!file) {
+		throw std::runtime_error("Failed to write input log '" + filename + "'.");
+	}
+}
+
+void InputLog::load(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open input log '" + filename + "'.");
+	}
+	std::vector< BlobChunk > toc;
+	read_blob_toc(file, &toc);
+	read_chunk(file, toc, "inp0", &frames);
+	read_chunk(file, toc, "evt0", &events);
+	read_chunk(file, toc, "key0", &keys);
+
+	//check that frames index the other chunks in order:
+	uint32_t events_end = 0;
+	uint32_t keys_end = 0;
+	for (auto const &f : frames) {
+		if (f.events_end < events_end || f.events_end > events.size()
+		 || f.keys_end < keys_end || f.keys_end > keys.size()) {
+			throw std::runtime_error("input log has out-of-range frame entries");
+		}
+		events_end = f.events_end;
+		keys_end = f.keys_end;
+	}
+	for (auto const &change : keys) {
+		if (change.scancode >= SDL_NUM_SCANCODES) {
+			throw std::runtime_error("input log has out-of-range scancode");
+		}
+	}
+
+	state.assign(SDL_NUM_SCANCODES, 0);
+	frame = -1U;
+	event = 0;
+}
+
+bool InputLog::next_frame() {
+	uint32_t next = frame + 1;
+	if (next >= frames.size()) return false;
+	uint32_t keys_begin = (next == 0 ? 0 : frames[next - 1].keys_end);
+	for (uint32_t k = keys_begin; k < frames[next].keys_end; ++k) {
+		state[keys[k].scancode] = keys[k].down;
+	}
+	event = (next == 0 ? 0 : frames[next - 1].events_end);
+	frame = next;
+	return true;
+}
+
+bool InputLog::next_event(SDL_Event *evt) {
+	if (frame >= frames.size() || event >= frames[frame].events_end) return false;
+	Event const &e = events[event++];
+
+	*evt = SDL_Event();
+	evt->type = e.type;
+	if (e.type == SDL_MOUSEMOTION) {
+		evt->motion.state = e.state;
+		evt->motion.x = e.x;
+		evt->motion.y = e.y;
+	} else if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+		evt->key.repeat = Uint8(e.state);
+		evt->key.keysym.sym = e.sym;
+		evt->key.keysym.scancode = SDL_Scancode(e.scancode);
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//InputLog records the input that drives the game loop -- SDL events, keyboard state, and each
+// frame's elapsed time -- so that a run can be played back exactly (e.g., for timing).
+//
+//Recording, once per frame:
+//  log.record_event(evt); //for each event the game handles
+//  log.record_frame(SDL_GetKeyboardState(NULL), elapsed);
+//Playback, once per frame:
+//  if (!log.next_frame()) break; //(out of recorded frames)
+//  while (log.next_event(&evt)) { ... }
+//  use log.keyboard() and log.elapsed()
+//
+//Only the event types the game reads are kept (mouse motion, key presses, quit).
+
+struct InputLog {
+	//recording:
+	void record_event(SDL_Event const &evt);
+	void record_frame(Uint8 const *keyboard, float elapsed); //ends the frame
+	// note: will throw if the file can't be written.
+	void save(std::string const &filename) const;
+
+	//playback:
+	// note: will throw if the file can't be read.
+	void load(std::string const &filename);
+	bool next_frame(); //advance to the next frame (false if there isn't one)
+	bool next_event(SDL_Event *evt); //the current frame's events, in order
+	Uint8 const *keyboard() const { return state.data(); } //(indexed by SDL_Scancode, like SDL_GetKeyboardState)
+	float elapsed() const { return frames[frame].elapsed; }
+	uint32_t frame_count() const { return uint32_t(frames.size()); }
+
+	//internals:
+	struct Frame {
+		float elapsed;
+		uint32_t events_end; //one past this frame's last entry in 'events'
+		uint32_t keys_end; //one past this frame's last entry in 'keys'
+	};
+	static_assert(sizeof(Frame) == 12, "Frame is packed");
+	struct Event {
+		uint32_t type;
+		uint32_t state; //mouse button state, or key repeat
+		int32_t x, y; //mouse position
+		int32_t sym; //SDL_Keycode
+		uint32_t scancode;
+	};
+	static_assert(sizeof(Event) == 24, "Event is packed");
+	struct KeyChange {
+		uint16_t scancode;
+		uint8_t down;
+		uint8_t padding;
+	};
+	static_assert(sizeof(KeyChange) == 4, "KeyChange is packed");
+	std::vector< Frame > frames;
+	std::vector< Event > events;
+	std::vector< KeyChange > keys; //keyboard state is stored as changes from the previous frame
+
+	std::vector< Uint8 > state = std::vector< Uint8 >(SDL_NUM_SCANCODES, 0); //keyboard state as of the current (or last recorded) frame
+	uint32_t frame = -1U; //(playback) current frame
+	uint32_t event = 0; //(playback) next event
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//MappedFile maps a whole file into memory, read-only, for as long as it exists:
+// pages are read in as they are touched, straight from the OS's file cache, so the file itself isn't
+// copied (or zero-filled) on the way to 'data'. (Whatever decodes it still makes its own copies -- e.g., Meshes
+// welds "v3n3" vertices in place, but unpacks "q16v" vertices one mesh at a time into a reused buffer.)
+// Use read_blob_toc(data, data + size, ...) (see Blob.hpp) and read_chunk(data, toc, ...) (see read_chunk.hpp) to get at the chunks in it.
+
+struct MappedFile {
+	//note: will throw if the file can't be opened or mapped.
+	MappedFile(std::string const &filename);
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+	~MappedFile();
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//internals:
+	void *handle = nullptr; //(windows) the file mapping object
+};
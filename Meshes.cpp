@@ -1,101 +1,566 @@
 #include "Meshes.hpp"
 #include "read_chunk.hpp"
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
+#include "VertexCache.hpp"
+#include "Simplify.hpp"
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
 
 void Meshes::load(std::string const &filename, Attributes const &attributes) {
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint vao = 0;
-	GLuint total = 0;
-	{ //read + upload data chunk:
-		struct v3n3 {
-			glm::vec3 v;
-			glm::vec3 n;
-			glm::vec3 c;
-		};
-		static_assert(sizeof(v3n3) == 36, "v3n3 is packed");
-		std::vector< v3n3 > data;
-		read_chunk(file, "v3n3", &data);
-
-		//upload data:
-		GLuint buffer = 0;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(v3n3) * data.size(), &data[0], GL_STATIC_DRAW);
-
-		total = data.size(); //store total for later checks on index
-
-		//store binding:
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		if (attributes.Position != -1U) {
-			glVertexAttribPointer(attributes.Position, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3), (GLbyte *)0);
-			glEnableVertexAttribArray(attributes.Position);
-		} else {
-			std::cerr << "WARNING: loading v3n3 data from '" << filename << "', but not using the Position attribute." << std::endl;
+	Cooked cooked;
+	cooked.source = filename;
+	cooked.attributes = attributes;
+	cooked.quantize = quantize;
+	cooked.lods = lods;
+	read(filename, map_files, &cooked);
+	size_t budget = SIZE_MAX;
+	upload(&cooked, &budget);
+}
+
+void Meshes::add(Vertex const *triangles, size_t triangles_count, std::vector< Range > const &ranges, Attributes const &attributes, std::string const &source) {
+	Cooked cooked;
+	cooked.source = source;
+	cooked.attributes = attributes;
+	cooked.quantize = quantize;
+	cooked.lods = lods;
+	cook(triangles, triangles_count, ranges, &cooked);
+	size_t budget = SIZE_MAX;
+	upload(&cooked, &budget);
+}
+
+Meshes::~Meshes() {
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	for (Cooked *cooked = finished.exchange(nullptr); cooked; ) {
+		Cooked *next = cooked->next;
+		delete cooked;
+		cooked = next;
+	}
+}
+
+void Meshes::load_async(std::string const &filename, Attributes const &attributes) {
+	Cooked *cooked = new Cooked;
+	cooked->source = filename;
+	cooked->attributes = attributes;
+	cooked->quantize = quantize;
+	cooked->lods = lods;
+	bool map = map_files;
+	cooking += 1;
+	workers.emplace_back([this, cooked, map]() {
+		try {
+			read(cooked->source, map, cooked);
+		} catch (...) {
+			cooked->error = std::current_exception(); //(rethrown by update())
 		}
-		if (attributes.Normal != -1U) {
-			glVertexAttribPointer(attributes.Normal, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3), (GLbyte *)0 + sizeof(glm::vec3));
-			glEnableVertexAttribArray(attributes.Normal);
-		} else {
-			std::cerr << "WARNING: loading v3n3 data from '" << filename << "', but not using the Normal attribute." << std::endl;
+		cooked->next = finished.load();
+		while (!finished.compare_exchange_weak(cooked->next, cooked)) {
+			//(cooked->next was updated to the current head; try again)
 		}
-		if (attributes.Color != -1U) {
-			glVertexAttribPointer(attributes.Color, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3), (GLbyte *)0 + 2 * sizeof(glm::vec3));
-			glEnableVertexAttribArray(attributes.Color);
-		} else {
-			std::cerr << "WARNING: loading v3n3 data from '" << filename << "', but not using the Color attribute." << std::endl;
+		cooking -= 1;
+	});
+}
+
+void Meshes::update(size_t budget) {
+	PROFILE_ZONE("Meshes::update");
+
+	//take everything finished so far (the list is newest-first) and queue it up oldest-first:
+	std::vector< Cooked * > taken;
+	for (Cooked *cooked = finished.exchange(nullptr); cooked; cooked = cooked->next) {
+		taken.emplace_back(cooked);
+	}
+	for (auto t = taken.rbegin(); t != taken.rend(); ++t) {
+		uploading.emplace_back(*t);
+	}
+
+	while (!uploading.empty()) {
+		if (uploading.front()->error) {
+			std::exception_ptr error = uploading.front()->error;
+			uploading.pop_front();
+			std::rethrow_exception(error);
 		}
+		if (!upload(uploading.front().get(), &budget)) break;
+		uploading.pop_front();
+	}
+}
+
+void Meshes::finish() {
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	update(SIZE_MAX);
+}
+
+bool Meshes::loading() const {
+	return cooking != 0 || finished.load() != nullptr || !uploading.empty();
+}
+
+void Meshes::read(std::string const &filename, bool map_files, Cooked *cooked) {
+	PROFILE_ZONE("Meshes::read");
+
+	//get the whole file in memory -- mapped, or (for comparison) read through an istream:
+	std::unique_ptr< MappedFile > mapped;
+	std::vector< char > buffer;
+	char const *begin = nullptr;
+	char const *end = nullptr;
+	if (map_files) {
+		mapped.reset(new MappedFile(filename));
+		begin = mapped->data;
+		end = mapped->data + mapped->size;
+	} else {
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.seekg(0, std::ios::end)) {
+			throw std::runtime_error("Failed to open '" + filename + "'.");
+		}
+		buffer.resize(size_t(file.tellg()));
+		file.seekg(0);
+		if (!file.read(buffer.data(), buffer.size())) {
+			throw std::runtime_error("Failed to read '" + filename + "'.");
+		}
+		begin = buffer.data();
+		end = buffer.data() + buffer.size();
+	}
+	cooked->stats.file_bytes += uint32_t(end - begin);
+
+	std::vector< BlobChunk > toc;
+	read_blob_toc(begin, end, &toc);
+
+	//which vertex chunk the file has says which vertex format it uses:
+	bool quantized = (find_chunk(toc, "q16v") != nullptr);
+
+	//(the views point into the file unless their chunk is misaligned, in which case they point into the scratch vectors)
+	static_assert(sizeof(Vertex) == 36, "Vertex is packed");
+	static_assert(sizeof(PackedVertex) == 16, "PackedVertex is packed");
+	std::vector< Vertex > data_scratch;
+	std::vector< PackedVertex > packed_scratch;
+	ChunkView< Vertex > data;
+	ChunkView< PackedVertex > packed;
+	PackedTriangles packed_triangles; //(quantized files are unpacked range by range while cooking)
+	if (quantized) {
+		packed = read_chunk(begin, toc, "q16v", &packed_scratch);
+		packed_triangles.vertices = packed.data;
+	} else {
+		data = read_chunk(begin, toc, "v3n3", &data_scratch);
 	}
+	size_t vertex_count = (quantized ? packed.size : data.size);
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	std::vector< char > strings_scratch;
+	ChunkView< char > strings = read_chunk(begin, toc, "str0", &strings_scratch);
 
-	{ //read index chunk, add to meshes:
+	std::vector< Range > ranges;
+	{ //read index chunk:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_start, vertex_count;
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		//(quantized files also give the box each entry's positions are relative to)
+		struct QuantizedIndexEntry {
+			IndexEntry entry;
+			glm::vec3 box_min, box_max;
+		};
+		static_assert(sizeof(QuantizedIndexEntry) == 40, "Quantized index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		std::vector< IndexEntry > index_scratch;
+		std::vector< QuantizedIndexEntry > quantized_index_scratch;
+		ChunkView< IndexEntry > index;
+		ChunkView< QuantizedIndexEntry > quantized_index;
+		if (quantized) {
+			quantized_index = read_chunk(begin, toc, "idxq", &quantized_index_scratch);
+		} else {
+			index = read_chunk(begin, toc, "idx0", &index_scratch);
+		}
 
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+		for (size_t i = 0; i < (quantized ? quantized_index.size : index.size); ++i) {
+			IndexEntry const &entry = (quantized ? quantized_index[i].entry : index[i]);
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size)) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
-			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= total)) {
+			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= vertex_count)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.vao = vao;
-			mesh.start = entry.vertex_start;
-			mesh.count = entry.vertex_count;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			if (quantized) {
+				packed_triangles.box_min.emplace_back(quantized_index[i].box_min);
+				packed_triangles.box_max.emplace_back(quantized_index[i].box_max);
+			}
+			Range range;
+			range.name = std::string(strings.data + entry.name_begin, strings.data + entry.name_end);
+			range.vertex_start = entry.vertex_start;
+			range.vertex_count = entry.vertex_count;
+			ranges.emplace_back(range);
+		}
+	}
+
+	cook(data.data, vertex_count, ranges, cooked, (quantized ? &packed_triangles : nullptr));
+}
+
+void Meshes::cook(Vertex const *triangles, size_t triangles_count, std::vector< Range > const &ranges, Cooked *cooked, PackedTriangles const *packed) {
+	PROFILE_ZONE("Meshes::cook");
+	std::string const &source = cooked->source;
+	Stats &stats = cooked->stats;
+	std::vector< uint32_t > &indices = cooked->indices; //(absolute, so draws don't need a base vertex)
+	std::vector< uint32_t > &mesh_indices = cooked->mesh_indices;
+	std::vector< Vertex > vertices; //welded vertices of every mesh, one after another
+	std::vector< Vertex > unpacked; //(the current range, if 'packed')
+
+	for (auto const &range : ranges) {
+		if (!(range.vertex_start + range.vertex_count <= triangles_count)) {
+			throw std::runtime_error("mesh '" + range.name + "' has out-of-range vertex start/count");
+		}
+		if (range.vertex_count % 3 != 0) {
+			std::cerr << "WARNING: mesh '" + range.name + "' in '" + source + "' has a partial triangle at the end (ignored)." << std::endl;
+		}
+		uint32_t unrolled_count = range.vertex_count / 3 * 3;
+		Vertex const *unrolled;
+		if (packed) {
+			uint32_t r = uint32_t(&range - &ranges[0]);
+			unpacked.clear();
+			unpacked.reserve(unrolled_count);
+			for (uint32_t i = 0; i < unrolled_count; ++i) {
+				unpacked.emplace_back(unpack(packed->vertices[range.vertex_start + i], packed->box_min[r], packed->box_max[r]));
+			}
+			unrolled = unpacked.data();
+		} else {
+			unrolled = triangles + range.vertex_start;
+		}
+
+		//weld vertices with exactly the same bits -- sort, then point each at the first of its run:
+		std::vector< uint32_t > sorted(unrolled_count);
+		for (uint32_t i = 0; i < unrolled_count; ++i) {
+			sorted[i] = i;
+		}
+		std::sort(sorted.begin(), sorted.end(), [unrolled](uint32_t a, uint32_t b) {
+			int c = std::memcmp(&unrolled[a], &unrolled[b], sizeof(Vertex));
+			return c < 0 || (c == 0 && a < b);
+		});
+		std::vector< uint32_t > weld(unrolled_count); //unrolled vertex -> first identical vertex
+		for (uint32_t i = 0; i < unrolled_count; ++i) {
+			bool same = (i > 0 && std::memcmp(&unrolled[sorted[i]], &unrolled[sorted[i - 1]], sizeof(Vertex)) == 0);
+			weld[sorted[i]] = (same ? weld[sorted[i - 1]] : sorted[i]);
+		}
+		std::vector< uint32_t > local(unrolled_count, -1U); //first identical vertex -> welded index
+		std::vector< uint32_t > mesh_triangles(unrolled_count);
+		std::vector< Vertex > mesh_vertices;
+		for (uint32_t i = 0; i < unrolled_count; ++i) {
+			uint32_t &w = local[weld[i]];
+			if (w == -1U) {
+				w = uint32_t(mesh_vertices.size());
+				mesh_vertices.emplace_back(unrolled[i]);
+			}
+			mesh_triangles[i] = w;
+		}
+
+		//reorder for the post-transform cache, then renumber vertices in the order they get used:
+		uint32_t welded_count = uint32_t(mesh_vertices.size());
+		stats.transformed_before += uint32_t(std::round(average_cache_miss_ratio(mesh_triangles, welded_count) * (unrolled_count / 3)));
+		optimize_vertex_cache(&mesh_triangles, welded_count);
+		stats.transformed += uint32_t(std::round(average_cache_miss_ratio(mesh_triangles, welded_count) * (unrolled_count / 3)));
+		std::vector< uint32_t > order;
+		order_vertices_by_use(&mesh_triangles, welded_count, &order);
+
+		stats.unrolled_vertices += unrolled_count;
+		stats.vertices += welded_count;
+		stats.triangles += unrolled_count / 3;
+
+		Mesh mesh;
+		mesh.start = GLuint(indices.size());
+		mesh.count = GLuint(mesh_triangles.size());
+		mesh.index = GLuint(&range - &ranges[0]);
+
+		uint32_t base = uint32_t(vertices.size());
+		for (auto v : order) {
+			vertices.emplace_back(mesh_vertices[v]);
+		}
+		for (auto i : mesh_triangles) {
+			indices.emplace_back(base + i);
+		}
+		mesh_indices.resize(vertices.size(), mesh.index);
+
+		//compute bounds:
+		if (!order.empty()) {
+			Vertex const *begin = &vertices[0] + base;
+			Vertex const *end = &vertices[0] + vertices.size();
+			mesh.bbox_min = mesh.bbox_max = begin->position;
+			for (Vertex const *vert = begin; vert != end; ++vert) {
+				mesh.bbox_min = glm::min(mesh.bbox_min, vert->position);
+				mesh.bbox_max = glm::max(mesh.bbox_max, vert->position);
+			}
+			mesh.sphere_center = 0.5f * (mesh.bbox_min + mesh.bbox_max);
+			float radius2 = 0.0f;
+			for (Vertex const *vert = begin; vert != end; ++vert) {
+				glm::vec3 d = vert->position - mesh.sphere_center;
+				radius2 = std::max(radius2, glm::dot(d, d));
+			}
+			mesh.sphere_radius = std::sqrt(radius2);
+		}
+
+		//pack into upload format:
+		if (cooked->quantize) {
+			mesh.dequantize_offset = mesh.bbox_min;
+			mesh.dequantize_scale = mesh.bbox_max - mesh.bbox_min;
+			cooked->vertex_data.resize(sizeof(PackedVertex) * vertices.size());
+			PackedVertex *packed = reinterpret_cast< PackedVertex * >(cooked->vertex_data.data());
+			for (uint32_t i = base; i < vertices.size(); ++i) {
+				packed[i] = pack(vertices[i], mesh.bbox_min, mesh.bbox_max);
+			}
+		} else {
+			cooked->vertex_data.resize(sizeof(Vertex) * vertices.size());
+			std::memcpy(cooked->vertex_data.data() + sizeof(Vertex) * base, vertices.data() + base, sizeof(Vertex) * (vertices.size() - base));
+		}
+
+		//simplify (after the bounds, which say how much error is too much; tiny meshes aren't worth it):
+		if (cooked->lods && mesh_triangles.size() >= 3 * 64) {
+			std::vector< uint32_t > targets;
+			for (uint32_t l = 1; l <= Mesh::MaxLODs; ++l) {
+				targets.emplace_back((uint32_t(mesh_triangles.size() / 3) >> l) * 3);
+			}
+			std::vector< glm::vec3 > positions(welded_count);
+			for (uint32_t i = 0; i < welded_count; ++i) {
+				positions[i] = vertices[base + i].position;
+			}
+			std::vector< std::vector< uint32_t > > levels;
+			std::vector< float > errors;
+			simplify_levels(mesh_triangles, positions.data(), welded_count, targets, 0.1f * mesh.sphere_radius, &levels, &errors);
+			for (uint32_t l = 0; l < levels.size(); ++l) {
+				optimize_vertex_cache(&levels[l], welded_count);
+				Mesh::LOD &lod = mesh.lods[mesh.lod_count++];
+				lod.start = GLuint(indices.size());
+				lod.count = GLuint(levels[l].size());
+				lod.error = errors[l];
+				for (auto i : levels[l]) {
+					indices.emplace_back(base + i);
+				}
+				stats.lod_triangles += lod.count / 3;
+			}
+		}
+
+		cooked->vertex_ends.emplace_back(uint32_t(vertices.size()));
+		cooked->index_ends.emplace_back(uint32_t(indices.size()));
+		cooked->meshes.emplace_back(range.name, mesh);
+	}
+}
+
+bool Meshes::upload(Cooked *cooked, size_t *budget) {
+	assert(budget);
+	auto before = std::chrono::high_resolution_clock::now();
+	std::string const &source = cooked->source;
+	Attributes const &attributes = cooked->attributes;
+	GLsizei stride = (cooked->quantize ? sizeof(PackedVertex) : sizeof(Vertex));
+
+	if (cooked->vao == 0) {
+		//make buffers for all of the data and store bindings (the data gets uploaded below):
+		glGenVertexArrays(1, &cooked->vao);
+		glBindVertexArray(cooked->vao);
+
+		glGenBuffers(1, &cooked->vertex_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, cooked->vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, cooked->vertex_data.size(), nullptr, GL_STATIC_DRAW);
+		stats.vertex_bytes += uint32_t(cooked->vertex_data.size());
+
+		auto bind = [&](GLuint location, char const *name, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+			if (location != -1U) {
+				glVertexAttribPointer(location, size, type, normalized, stride, (GLbyte *)0 + offset);
+				glEnableVertexAttribArray(location);
+			} else {
+				std::cerr << "WARNING: loading mesh data from '" << source << "', but not using the " << name << " attribute." << std::endl;
 			}
+		};
+		if (cooked->quantize) {
+			//(normalized, so positions arrive as fractions of the box -- see Mesh::dequantize_scale)
+			bind(attributes.Position, "Position", 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+			bind(attributes.Normal, "Normal", 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal));
+			bind(attributes.Color, "Color", 3, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PackedVertex, color));
+		} else {
+			bind(attributes.Position, "Position", 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+			bind(attributes.Normal, "Normal", 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+			bind(attributes.Color, "Color", 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, color));
+		}
+
+		if (attributes.MeshIndex != -1U) {
+			glGenBuffers(1, &cooked->mesh_index_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, cooked->mesh_index_buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(uint32_t) * cooked->mesh_indices.size(), nullptr, GL_STATIC_DRAW);
+			glVertexAttribIPointer(attributes.MeshIndex, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (GLbyte *)0);
+			glEnableVertexAttribArray(attributes.MeshIndex);
+		}
+
+		//(the element buffer binding is part of the VAO's state)
+		glGenBuffers(1, &cooked->index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cooked->index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * cooked->indices.size(), nullptr, GL_STATIC_DRAW);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//upload (as much of the budget allows of) the next range of a buffer's data:
+	// (through GL_COPY_WRITE_BUFFER, so no VAO needs to be bound for the element buffer)
+	auto part = [budget](GLuint buffer, void const *data, size_t *done, size_t until) {
+		size_t bytes = std::min(until - *done, *budget);
+		if (bytes != 0) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, *done, bytes, reinterpret_cast< char const * >(data) + *done);
+			*done += bytes;
+			*budget -= bytes;
+		}
+		return *done == until;
+	};
+
+	//meshes become resident one at a time, once all of their data is in:
+	while (cooked->uploaded_meshes < cooked->meshes.size()) {
+		auto const &named = cooked->meshes[cooked->uploaded_meshes];
+		uint32_t vertex_end = cooked->vertex_ends[cooked->uploaded_meshes];
+		bool done = part(cooked->vertex_buffer, cooked->vertex_data.data(), &cooked->vertex_bytes_done, size_t(stride) * vertex_end);
+		if (cooked->mesh_index_buffer) {
+			done = part(cooked->mesh_index_buffer, cooked->mesh_indices.data(), &cooked->mesh_index_bytes_done, sizeof(uint32_t) * vertex_end) && done;
 		}
+		done = part(cooked->index_buffer, cooked->indices.data(), &cooked->index_bytes_done, sizeof(uint32_t) * cooked->index_ends[cooked->uploaded_meshes]) && done;
+		if (!done) break;
+
+		Mesh mesh = named.second;
+		mesh.vao = cooked->vao;
+		insert(named.first, mesh, source);
+		++cooked->uploaded_meshes;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	bool complete = (cooked->uploaded_meshes == cooked->meshes.size());
+	if (complete) {
+		stats.unrolled_vertices += cooked->stats.unrolled_vertices;
+		stats.vertices += cooked->stats.vertices;
+		stats.triangles += cooked->stats.triangles;
+		stats.transformed_before += cooked->stats.transformed_before;
+		stats.transformed += cooked->stats.transformed;
+		stats.lod_triangles += cooked->stats.lod_triangles;
+		stats.file_bytes += cooked->stats.file_bytes;
+	}
+	stats.upload_seconds += std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	return complete;
+}
+
+Meshes::PackedVertex Meshes::pack(Vertex const &vertex, glm::vec3 const &box_min, glm::vec3 const &box_max) {
+	PackedVertex packed;
+	glm::vec3 extent = box_max - box_min;
+	for (uint32_t c = 0; c < 3; ++c) {
+		float t = (extent[c] > 0.0f ? (vertex.position[c] - box_min[c]) / extent[c] : 0.0f);
+		packed.position[c] = uint16_t(std::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+	}
+	packed.position[3] = 0;
+
+	//signed 10-bit x, y, z (w stays zero):
+	packed.normal = 0;
+	for (uint32_t c = 0; c < 3; ++c) {
+		int32_t n = int32_t(std::round(glm::clamp(vertex.normal[c], -1.0f, 1.0f) * 511.0f));
+		packed.normal |= (uint32_t(n) & 0x3ff) << (10 * c);
+	}
+
+	for (uint32_t c = 0; c < 3; ++c) {
+		packed.color[c] = uint8_t(std::round(glm::clamp(vertex.color[c], 0.0f, 1.0f) * 255.0f));
+	}
+	packed.color[3] = 0xff;
+	return packed;
+}
+
+Meshes::Vertex Meshes::unpack(PackedVertex const &packed, glm::vec3 const &box_min, glm::vec3 const &box_max) {
+	Vertex vertex;
+	for (uint32_t c = 0; c < 3; ++c) {
+		vertex.position[c] = box_min[c] + (box_max[c] - box_min[c]) * (packed.position[c] / 65535.0f);
+		int32_t n = int32_t((packed.normal >> (10 * c)) & 0x3ff);
+		if (n >= 512) n -= 1024;
+		vertex.normal[c] = std::max(-1.0f, n / 511.0f);
+		vertex.color[c] = packed.color[c] / 255.0f;
+	}
+	return vertex;
+}
+
+uint32_t Meshes::hash(std::string const &name) {
+	//FNV-1a:
+	uint32_t hash = 2166136261U;
+	for (char c : name) {
+		hash = (hash ^ uint32_t(uint8_t(c))) * 16777619U;
+	}
+	return hash;
+}
+
+MeshID Meshes::lookup(std::string const &name) const {
+	if (table.empty()) return -1U;
+	uint32_t h = hash(name);
+	uint32_t mask = uint32_t(table.size()) - 1;
+	//(the table always has empty slots, so this stops)
+	for (uint32_t s = h & mask; table[s].id != -1U; s = (s + 1) & mask) {
+		if (table[s].hash == h && names[table[s].id] == name) return table[s].id;
 	}
+	return -1U;
+}
+
+MeshID Meshes::intern(std::string const &name) {
+	MeshID id = lookup(name);
+	if (id != -1U) return id;
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
+	//grow (rehashing everything) to stay at most half full:
+	if (2 * (names.size() + 1) > table.size()) {
+		std::vector< Slot > old;
+		old.swap(table);
+		table.resize(std::max< size_t >(64, 2 * old.size()));
+		uint32_t mask = uint32_t(table.size()) - 1;
+		for (Slot const &slot : old) {
+			if (slot.id == -1U) continue;
+			uint32_t s = slot.hash & mask;
+			while (table[s].id != -1U) s = (s + 1) & mask;
+			table[s] = slot;
+		}
 	}
+
+	uint32_t h = hash(name);
+	uint32_t mask = uint32_t(table.size()) - 1;
+	uint32_t s = h & mask;
+	while (table[s].id != -1U) s = (s + 1) & mask;
+	id = MeshID(names.size());
+	table[s].hash = h;
+	table[s].id = id;
+	names.emplace_back(name);
+	by_id.emplace_back(nullptr);
+	return id;
+}
+
+void Meshes::insert(std::string const &name, Mesh const &mesh, std::string const &source) {
+	MeshID id = intern(name);
+	if (by_id[id]) {
+		std::cerr << "WARNING: mesh name '" + name + "' in '" + source + "' collides with existing mesh." << std::endl;
+		return;
+	}
+	resident.emplace_back(mesh);
+	by_id[id] = &resident.back();
+}
+
+Mesh const *Meshes::find(std::string const &name) const {
+	return find(lookup(name));
 }
 
 Mesh const &Meshes::get(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+	return get(lookup(name));
+}
+
+Mesh const &Meshes::get(MeshID id) const {
+	Mesh const *mesh = find(id);
+	if (!mesh) {
 		throw std::runtime_error("Looking up mesh that doesn't exist.");
 	}
-	return f->second;
+	return *mesh;
 }
@@ -1,32 +1,199 @@
 #pragma once
 
 #include "GL.hpp"
-#include <map>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 //Mesh is a lightweight handle to some OpenGL vertex data:
+// meshes are indexed triangle lists -- draw with glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, start * 4)
+// while 'vao' (which has the element buffer attached) is bound.
 struct Mesh {
 	GLuint vao = 0;
-	GLuint start = 0;
-	GLuint count = 0;
+	GLuint start = 0; //first index (in the VAO's element buffer)
+	GLuint count = 0; //number of indices
+	//which mesh in the file this is (the value of the MeshIndex attribute on its vertices):
+	GLuint index = -1U;
+	//bounding volumes (in mesh-local coordinates):
+	glm::vec3 bbox_min = glm::vec3(0.0f);
+	glm::vec3 bbox_max = glm::vec3(0.0f);
+	glm::vec3 sphere_center = glm::vec3(0.0f);
+	float sphere_radius = 0.0f;
+	//the Position attribute may be quantized (see Meshes::quantize); it maps to mesh-local coordinates as
+	// dequantize_offset + dequantize_scale * Position, which gets folded into the draw's mvp:
+	glm::vec3 dequantize_scale = glm::vec3(1.0f);
+	glm::vec3 dequantize_offset = glm::vec3(0.0f);
+	//coarser levels of detail, each a range of the same element buffer that uses the same vertices (see Meshes::lods):
+	struct LOD {
+		GLuint start = 0;
+		GLuint count = 0;
+		float error = 0.0f; //how far it may stray from the full mesh (in mesh-local units; see simplify_levels())
+	};
+	enum : uint32_t { MaxLODs = 3 };
+	LOD lods[MaxLODs];
+	uint32_t lod_count = 0;
 };
 
+//MeshID names a mesh by a small integer that Meshes::intern() hands out for its name (the first name gets 0, the next 1, ...):
+// intern a name once, then look it up by id without building, hashing, or comparing strings.
+typedef uint32_t MeshID;
+
 //"Meshes" loads a collection of meshes and builds VAOs for 'em
 // you pass in a 'Bindings' object to specify which attributes to bind where
 
 struct Meshes {
+	Meshes() = default;
+	Meshes(Meshes const &) = delete;
+	~Meshes(); //(waits for background loads)
+
 	struct Attributes {
 		GLuint Position = -1U;
 		GLuint Normal = -1U;
 		GLuint Color = -1U;
+		GLuint MeshIndex = -1U; //(optional) integer attribute telling which mesh a vertex is part of
 	};
 	//add meshes from a file; use the indicated indices for attribute locations:
 	// note: will throw if file fails to read.
 	void load(std::string const &filename, Attributes const &attributes);
 
-	//look up a particular mesh in the DB:
+	//...or load a file in the background: a worker thread reads and cooks it (welding, reordering,
+	// packing), then update() uploads it a piece at a time. Each mesh can be found with find()
+	// once all of its data is uploaded.
+	void load_async(std::string const &filename, Attributes const &attributes);
+	//upload background-loaded data, at most 'budget' bytes of it (call once a frame, on the GL thread):
+	// note: will throw if a background load failed.
+	void update(size_t budget);
+	//wait for every background load, then upload all of it:
+	void finish();
+	//are any background loads still being read or uploaded?
+	bool loading() const;
+
+	//load() and load_async() read files through a memory mapping (see MappedFile), rather than copying them in with an istream
+	// (full-precision vertices are cooked right from the mapping; quantized ones are unpacked a mesh at a time):
+	bool map_files = true;
+
+	//mesh files are chunks of vertex data, names ("str0"), and an index of named ranges:
+	// - "v3n3" vertices with an "idx0" index, or
+	// - "q16v" vertices with an "idxq" index, which also gives the box each range's positions are quantized to.
+
+	//full-precision vertex format (36 bytes, "v3n3" chunks):
+	struct Vertex {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec3 color;
+	};
+	//quantized vertex format (16 bytes, "q16v" chunks):
+	struct PackedVertex {
+		uint16_t position[4]; //xyz as fractions of the way across the mesh's box (w unused)
+		uint32_t normal; //GL_INT_2_10_10_10_REV (w unused)
+		uint8_t color[4]; //rgb, normalized (a unused)
+	};
+	static PackedVertex pack(Vertex const &vertex, glm::vec3 const &box_min, glm::vec3 const &box_max);
+	static Vertex unpack(PackedVertex const &packed, glm::vec3 const &box_min, glm::vec3 const &box_max);
+
+	//upload PackedVertex data rather than Vertex data (whichever format the file used):
+	bool quantize = true;
+
+	//simplify each mesh into up to Mesh::MaxLODs coarser levels of detail -- about 1/2, 1/4, and 1/8 of its triangles,
+	// stopping early where that would stray more than a tenth of its bounding radius (see Simplify.hpp):
+	bool lods = true;
+
+	//a named range of unrolled triangles (three vertices each), as listed in a mesh file's index:
+	struct Range {
+		std::string name;
+		uint32_t vertex_start;
+		uint32_t vertex_count;
+	};
+	//add meshes from 'triangles_count' unrolled triangle vertices (all sharing one new VAO): identical vertices within each
+	// mesh are welded together, and triangles are ordered for the post-transform vertex cache.
+	// 'source' names where the data came from, for warnings.
+	void add(Vertex const *triangles, size_t triangles_count, std::vector< Range > const &ranges, Attributes const &attributes, std::string const &source);
+
+	//the id for a name -- the same one every time, whether or not a mesh by that name has been loaded (yet):
+	MeshID intern(std::string const &name);
+
+	//look up a particular mesh in the DB (neither lookup allocates):
 	// note: will throw if mesh not found.
+	Mesh const &get(MeshID id) const;
 	Mesh const &get(std::string const &name) const;
+	//...or get nullptr if it isn't there (yet):
+	Mesh const *find(MeshID id) const { return (id < by_id.size() ? by_id[id] : nullptr); }
+	Mesh const *find(std::string const &name) const;
+	//number of meshes that can be found:
+	size_t size() const { return resident.size(); }
+
+	//totals over everything added, to see what welding and reordering saved:
+	struct Stats {
+		uint32_t unrolled_vertices = 0; //vertices before welding (three per triangle)
+		uint32_t vertices = 0; //vertices after welding
+		uint32_t triangles = 0;
+		uint32_t transformed_before = 0; //vertex shader runs to draw every mesh once (16-entry FIFO cache model), before reordering
+		uint32_t transformed = 0; //...and after
+		uint32_t lod_triangles = 0; //triangles in coarser levels of detail
+		uint32_t file_bytes = 0; //size of the mesh files loaded
+		uint32_t vertex_bytes = 0; //size of the vertex buffers uploaded
+		double upload_seconds = 0.0; //time spent packing vertices and handing them to OpenGL
+	} stats;
 
 	//internals:
-	std::map< std::string, Mesh > meshes;
+	//meshes that are fully uploaded, in the order they arrived (a deque, so pointers from find() stay valid):
+	std::deque< Mesh > resident;
+	//interned names, and the resident mesh (or nullptr) for each, indexed by MeshID:
+	std::vector< std::string > names;
+	std::vector< Mesh const * > by_id;
+	//open-addressing table (linear probing, power-of-two size, at most half full) from name to id:
+	// slots keep the name's hash, so probing only compares names whose hashes match.
+	struct Slot {
+		uint32_t hash = 0;
+		MeshID id = -1U; //-1U marks an empty slot
+	};
+	std::vector< Slot > table;
+	static uint32_t hash(std::string const &name);
+	MeshID lookup(std::string const &name) const; //id, or -1U if the name was never interned
+	//make a newly uploaded mesh findable (warns and skips it if a mesh by that name is already resident):
+	void insert(std::string const &name, Mesh const &mesh, std::string const &source);
+
+	//meshes read and cooked on the CPU, ready to upload:
+	struct Cooked {
+		std::string source;
+		Attributes attributes;
+		bool quantize = true;
+		bool lods = true;
+		std::vector< std::pair< std::string, Mesh > > meshes; //(vao is filled in by upload())
+		std::vector< uint32_t > vertex_ends; //end of each mesh's vertices
+		std::vector< uint32_t > index_ends; //end of each mesh's indices (including its levels of detail)
+		std::vector< char > vertex_data; //PackedVertex or Vertex, per 'quantize'
+		std::vector< uint32_t > mesh_indices; //MeshIndex value for each vertex
+		std::vector< uint32_t > indices;
+		Stats stats; //(for everything but the uploads)
+		std::exception_ptr error; //(if reading or cooking failed)
+		//upload progress:
+		GLuint vao = 0, vertex_buffer = 0, mesh_index_buffer = 0, index_buffer = 0;
+		size_t uploaded_meshes = 0;
+		size_t vertex_bytes_done = 0, mesh_index_bytes_done = 0, index_bytes_done = 0;
+		Cooked *next = nullptr; //(in the 'finished' list)
+	};
+	//fill in 'cooked' from a file or from unrolled triangles (doesn't touch OpenGL, so can run on any thread):
+	static void read(std::string const &filename, bool map_files, Cooked *cooked);
+	//(quantized files are cooked straight from their PackedVertex data, unpacking one range at a time:)
+	struct PackedTriangles {
+		PackedVertex const *vertices = nullptr;
+		std::vector< glm::vec3 > box_min, box_max; //per range
+	};
+	static void cook(Vertex const *triangles, size_t triangles_count, std::vector< Range > const &ranges, Cooked *cooked, PackedTriangles const *packed = nullptr);
+	//upload up to *budget bytes of 'cooked', mesh by mesh, and subtract what was uploaded;
+	// returns true once all of it is resident:
+	bool upload(Cooked *cooked, size_t *budget);
+
+	//background loads push onto 'finished' (a lock-free stack) when done, and update() takes the whole list:
+	std::atomic< Cooked * > finished{nullptr};
+	std::atomic< uint32_t > cooking{0}; //background loads not yet pushed onto 'finished'
+	std::deque< std::unique_ptr< Cooked > > uploading; //taken from 'finished', oldest first
+	std::vector< std::thread > workers;
 };
@@ -0,0 +1,134 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+//every thread that has recorded anything (buffers live until exit, so late dumps can still see them):
+static std::mutex &threads_mutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+static std::vector< std::unique_ptr< Profiler::Thread > > &threads() {
+	static std::vector< std::unique_ptr< Profiler::Thread > > list;
+	return list;
+}
+
+uint64_t Profiler::now() {
+	static const auto start = std::chrono::steady_clock::now();
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+}
+
+static Profiler::Thread &register_thread(std::string const &name) {
+	std::unique_ptr< Profiler::Thread > created(new Profiler::Thread);
+	created->written = 0;
+	created->events.resize(Profiler::Capacity);
+	std::lock_guard< std::mutex > lock(threads_mutex());
+	created->id = uint32_t(threads().size());
+	created->name = (name.empty() ? (created->id == 0 ? "main" : "thread " + std::to_string(created->id)) : name);
+	threads().emplace_back(std::move(created));
+	return *threads().back();
+}
+
+Profiler::Thread &Profiler::local() {
+	thread_local Thread *thread = nullptr;
+	if (!thread) thread = &register_thread("");
+	return *thread;
+}
+
+Profiler::Thread &Profiler::track(std::string const &name) {
+	return register_thread(name);
+}
+
+void Profiler::record(char const *name, uint64_t begin, uint64_t end) {
+	record(local(), name, begin, end);
+}
+
+void Profiler::record(Thread &thread, char const *name, uint64_t begin, uint64_t end) {
+	uint64_t index = thread.written.load(std::memory_order_relaxed);
+	Event &event = thread.events[index & (Capacity - 1)];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	thread.written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::frame() {
+	static uint64_t frame_begin = now();
+	uint64_t frame_end = now();
+	record("frame", frame_begin, frame_end);
+	frame_begin = frame_end;
+}
+
+//string literals only need quotes and backslashes escaped:
+static void write_json_string(std::ostream &out, char const *str) {
+	out << '"';
+	for (char const *c = str; *c; ++c) {
+		if (*c == '"' || *c == '\\') out << '\\';
+		out << *c;
+	}
+	out << '"';
+}
+
+bool Profiler::write_trace(std::string const &filename, uint32_t frames) {
+	//copy out every thread's events:
+	std::vector< std::pair< uint32_t, Event > > events; //(thread id, event)
+	{
+		std::lock_guard< std::mutex > lock(threads_mutex());
+		for (auto const &thread : threads()) {
+			uint64_t written = thread->written.load(std::memory_order_acquire);
+			uint64_t first = (written > Capacity ? written - Capacity : 0);
+			size_t start = events.size();
+			for (uint64_t i = first; i < written; ++i) {
+				events.emplace_back(thread->id, thread->events[i & (Capacity - 1)]);
+			}
+			//drop anything the owning thread may have overwritten while it was being copied:
+			uint64_t after = thread->written.load(std::memory_order_acquire);
+			if (after > first + Capacity) {
+				size_t torn = size_t(std::min(after - (first + Capacity), written - first));
+				events.erase(events.begin() + start, events.begin() + start + torn);
+			}
+		}
+	}
+
+	//find where the window of frames starts:
+	std::vector< uint64_t > frame_begins;
+	for (auto const &event : events) {
+		if (std::string(event.second.name) == "frame") frame_begins.emplace_back(event.second.begin);
+	}
+	std::sort(frame_begins.begin(), frame_begins.end());
+	uint64_t window_begin = 0;
+	if (frames != 0 && frame_begins.size() > frames) {
+		window_begin = frame_begins[frame_begins.size() - frames];
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	{
+		std::lock_guard< std::mutex > lock(threads_mutex());
+		for (auto const &thread : threads()) {
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->id << ",\"args\":{\"name\":";
+			write_json_string(out, thread->name.c_str());
+			out << "}}";
+			first = false;
+		}
+	}
+	out.precision(3);
+	out << std::fixed;
+	for (auto const &event : events) {
+		if (event.second.begin < window_begin) continue;
+		out << (first ? "" : ",\n") << "{\"name\":";
+		write_json_string(out, event.second.name);
+		out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.first
+		    << ",\"ts\":" << (event.second.begin / 1000.0)
+		    << ",\"dur\":" << ((event.second.end - event.second.begin) / 1000.0) << "}";
+		first = false;
+	}
+	out << "\n]}\n";
+	return bool(out);
+}
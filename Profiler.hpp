@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Profiler records timed, named zones into per-thread ring buffers, and can write the last
+// few frames' worth out as Chrome trace_event JSON (open in chrome://tracing or ui.perfetto.dev).
+//
+//  PROFILE_ZONE("Scene::render"); //times the rest of the enclosing scope
+//  PROFILE_FRAME(); //marks the end of a frame (call once per frame, from the main thread)
+//
+//Recording is cheap (two clock reads and a store into a buffer only the recording thread writes).
+//Compile with -DPROFILER_DISABLED to remove all PROFILE_* macros from the build.
+
+struct Profiler {
+	//RAII zone; 'name' must outlive the profiler (use string literals):
+	struct Zone {
+		explicit Zone(char const *name_) : name(name_), begin(now()) { }
+		~Zone() { record(name, begin, now()); }
+		Zone(Zone const &) = delete;
+		char const *name;
+		uint64_t begin;
+	};
+
+	//end the current frame (frames are recorded as zones named "frame"):
+	static void frame();
+
+	//write every zone that began during the last 'frames' frames to a trace file:
+	// returns false if the file couldn't be written.
+	// (call between frames -- zones being recorded during the write may be left out)
+	static bool write_trace(std::string const &filename, uint32_t frames);
+
+	//internals:
+	struct Event {
+		char const *name;
+		uint64_t begin, end; //nanoseconds, from now()
+	};
+	enum : uint32_t { Capacity = 1 << 16 }; //events per thread (a power of two)
+	struct Thread { //ring buffer for one thread (written only by that thread)
+		uint32_t id = 0;
+		std::string name;
+		std::atomic< uint64_t > written; //events ever recorded; the newest is at (written - 1) % Capacity
+		std::vector< Event > events;
+	};
+	static uint64_t now();
+	static void record(char const *name, uint64_t begin, uint64_t end);
+	static void record(Thread &thread, char const *name, uint64_t begin, uint64_t end);
+	static Thread &local(); //this thread's buffer (registered on first use)
+	//a buffer for events that didn't happen on a CPU thread (e.g., GPU passes):
+	// (still only one thread may record to it)
+	static Thread &track(std::string const &name);
+};
+
+#ifndef PROFILER_DISABLED
+#define PROFILE_CONCAT2(A, B) A ## B
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT2(A, B)
+#define PROFILE_ZONE(NAME) Profiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__)(NAME)
+#define PROFILE_FRAME() Profiler::frame()
+#else
+#define PROFILE_ZONE(NAME) do { } while (0)
+#define PROFILE_FRAME() do { } while (0)
+#endif
@@ -0,0 +1,233 @@
+#include "Programs.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static GLuint compile_shader(GLenum type, std::string const &source);
+static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
+
+Programs::Programs() {
+	//lights come from the "Lights" block, used by both stages:
+	std::string lights_source =
+		"struct Light {\n"
+		"	vec4 position;\n"
+		"	vec4 intensity;\n"
+		"};\n"
+		"layout(std140) uniform Lights {\n"
+		"	mat4 clip_to_camera;\n"
+		"	Light lights[MAX_LIGHTS];\n"
+		"};\n"
+	;
+
+	std::string vertex_source =
+		"#ifdef INSTANCED\n"
+		"layout(location = INSTANCE_MVP_LOCATION) in mat4 mvp;\n"
+		"layout(location = INSTANCE_ITMV_LOCATION) in mat3 itmv;\n"
+		"layout(location = INSTANCE_LIGHTS_LOCATION) in uvec2 light_list;\n"
+		"#elif defined(MATRICES_BLOCK)\n"
+		"layout(std140) uniform Matrices {\n"
+		"	mat4 mvp;\n"
+		"	mat3 itmv;\n"
+		"	uvec2 light_list;\n"
+		"};\n"
+		"#elif defined(MULTIDRAW)\n"
+		"layout(location = 3) in uint MeshIndex;\n"
+		"uniform samplerBuffer multidraw_matrices;\n"
+		"uniform usamplerBuffer multidraw_slots;\n"
+		"uniform int slot_base;\n"
+		"mat4 mvp;\n"
+		"mat3 itmv;\n"
+		"uvec2 light_list;\n"
+		"#else\n"
+		"uniform mat4 mvp;\n"
+		"uniform mat3 itmv;\n"
+		"uniform uvec2 light_list;\n"
+		"#endif\n"
+		//(fixed locations so that every variant works with the same VAOs)
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec3 Color;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec3 color;\n"
+		"flat out uvec2 draw_lights;\n"
+		"void main() {\n"
+		"#ifdef MULTIDRAW\n"
+		"	int texel = 8 * int(texelFetch(multidraw_slots, slot_base + int(MeshIndex)).r);\n"
+		"	mvp = mat4(texelFetch(multidraw_matrices, texel), texelFetch(multidraw_matrices, texel + 1),\n"
+		"		texelFetch(multidraw_matrices, texel + 2), texelFetch(multidraw_matrices, texel + 3));\n"
+		"	itmv = mat3(texelFetch(multidraw_matrices, texel + 4).xyz, texelFetch(multidraw_matrices, texel + 5).xyz,\n"
+		"		texelFetch(multidraw_matrices, texel + 6).xyz);\n"
+		"	light_list = floatBitsToUint(texelFetch(multidraw_matrices, texel + 7).xy);\n"
+		"#endif\n"
+		"	gl_Position = mvp * Position;\n"
+		"	vec4 camera_position = clip_to_camera * gl_Position;\n"
+		"	position = camera_position.xyz / camera_position.w;\n"
+		"	normal = itmv * Normal;\n"
+		"	color = Color;\n"
+		"	draw_lights = light_list;\n"
+		"}\n"
+	;
+
+	std::string fragment_source =
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec3 color;\n"
+		"flat in uvec2 draw_lights;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 light = vec3(0.0);\n"
+		"	for (int i = 0; i < MAX_OBJECT_LIGHTS; ++i) {\n"
+		"		uint index = (draw_lights[i / 4] >> uint(8 * (i % 4))) & 0xffu;\n"
+		"		if (index == 0u) break;\n"
+		"		Light l = lights[index - 1u];\n"
+		"		vec3 to_light = l.position.xyz;\n"
+		"		float falloff = 1.0;\n"
+		"		if (l.position.w != 0.0) {\n"
+		//point light: inverse-square, windowed to reach zero at its range
+		"			to_light -= position;\n"
+		"			float d2 = dot(to_light, to_light);\n"
+		"			to_light *= inversesqrt(d2);\n"
+		"			float r2 = l.intensity.w * l.intensity.w;\n"
+		"			float window = clamp(1.0 - (d2 * d2) / (r2 * r2), 0.0, 1.0);\n"
+		"			falloff = window * window / max(d2, 1e-4);\n"
+		"		}\n"
+		"		float nl = dot(n, to_light);\n"
+		"		light += l.intensity.rgb * falloff * (smoothstep(0.0, 0.1, nl) * 0.6 + 0.4);\n"
+		"	}\n"
+		"   vec3 ambience = color * 0.1;\n"
+		"	fragColor = vec4(ambience + (color / 3.1415926) * light, 1.0);\n"
+		"}\n"
+	;
+
+	auto make_program = [&](std::string const &defines) {
+		std::string prefix = "#version 330\n"
+			"#define MAX_LIGHTS " + std::to_string(Scene::MaxLights) + "\n"
+			"#define MAX_OBJECT_LIGHTS " + std::to_string(Scene::MaxObjectLights) + "\n"
+			+ defines + lights_source;
+		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, prefix + vertex_source);
+		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, prefix + fragment_source);
+		GLuint linked = link_program(fragment_shader, vertex_shader);
+
+		//every variant reads lights from the buffer Scene::render() binds:
+		GLuint lights_block = glGetUniformBlockIndex(linked, "Lights");
+		if (lights_block == GL_INVALID_INDEX) throw std::runtime_error("no uniform block named Lights");
+		glUniformBlockBinding(linked, lights_block, Scene::LightsBinding);
+		return linked;
+	};
+
+	program = make_program("");
+	instanced_program = make_program(
+		"#define INSTANCED\n"
+		"#define INSTANCE_MVP_LOCATION " + std::to_string(Scene::InstanceMVPLocation) + "\n"
+		"#define INSTANCE_ITMV_LOCATION " + std::to_string(Scene::InstanceITMVLocation) + "\n"
+		"#define INSTANCE_LIGHTS_LOCATION " + std::to_string(Scene::InstanceLightsLocation) + "\n"
+	);
+	matrices_program = make_program("#define MATRICES_BLOCK\n");
+	multidraw_program = make_program("#define MULTIDRAW\n");
+
+	//look up attribute locations:
+	program_Position = glGetAttribLocation(program, "Position");
+	if (program_Position == -1U) throw std::runtime_error("no attribute named Position");
+	program_Normal = glGetAttribLocation(program, "Normal");
+	if (program_Normal == -1U) throw std::runtime_error("no attribute named Normal");
+	program_Color = glGetAttribLocation(program, "Color");
+	if (program_Color == -1U) throw std::runtime_error("no attribute named Color");
+
+	//look up uniform locations:
+	program_mvp = glGetUniformLocation(program, "mvp");
+	if (program_mvp == -1U) throw std::runtime_error("no uniform named mvp");
+	program_itmv = glGetUniformLocation(program, "itmv");
+	if (program_itmv == -1U) throw std::runtime_error("no uniform named itmv");
+	program_light_list = glGetUniformLocation(program, "light_list");
+	if (program_light_list == -1U) throw std::runtime_error("no uniform named light_list");
+
+	//look up uniform block and attach it to the binding point Scene::render() uses:
+	matrices_program_block = glGetUniformBlockIndex(matrices_program, "Matrices");
+	if (matrices_program_block == GL_INVALID_INDEX) throw std::runtime_error("no uniform block named Matrices");
+	glUniformBlockBinding(matrices_program, matrices_program_block, Scene::MatricesBinding);
+
+	multidraw_program_MeshIndex = glGetAttribLocation(multidraw_program, "MeshIndex");
+	if (multidraw_program_MeshIndex == -1U) throw std::runtime_error("no attribute named MeshIndex");
+	multidraw_program_slot_base = glGetUniformLocation(multidraw_program, "slot_base");
+	if (multidraw_program_slot_base == -1U) throw std::runtime_error("no uniform named slot_base");
+
+	//point buffer textures at the units Scene::render() binds them to:
+	glUseProgram(multidraw_program);
+	glUniform1i(glGetUniformLocation(multidraw_program, "multidraw_matrices"), Scene::MultiDrawMatricesUnit);
+	glUniform1i(glGetUniformLocation(multidraw_program, "multidraw_slots"), Scene::MultiDrawSlotsUnit);
+	glUseProgram(0);
+}
+
+char const *Programs::mode_name(Mode mode) {
+	if (mode == MultiDraw) return "multi-draw";
+	if (mode == UniformBuffer) return "uniform buffer";
+	return "per-draw uniforms";
+}
+
+void Programs::set(Scene::Object &object, Mode mode) const {
+	object.program = (mode == Uniforms ? program : matrices_program);
+	object.program_mvp = program_mvp;
+	object.program_itmv = program_itmv;
+	object.program_lights = program_light_list;
+	object.program_matrices = (mode == Uniforms ? -1U : matrices_program_block);
+	object.instanced_program = instanced_program;
+	object.multidraw_program = (mode == MultiDraw ? multidraw_program : 0);
+	object.multidraw_program_slot_base = multidraw_program_slot_base;
+}
+
+Meshes::Attributes Programs::attributes() const {
+	Meshes::Attributes attributes;
+	attributes.Position = program_Position;
+	attributes.Normal = program_Normal;
+	attributes.Color = program_Color;
+	attributes.MeshIndex = multidraw_program_MeshIndex;
+	return attributes;
+}
+
+//---------------------------
+
+static GLuint compile_shader(GLenum type, std::string const &source) {
+	GLuint shader = glCreateShader(type);
+	GLchar const *str = source.c_str();
+	GLint length = source.size();
+	glShaderSource(shader, 1, &str, &length);
+	glCompileShader(shader);
+	GLint compile_status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+	if (compile_status != GL_TRUE) {
+		std::cerr << "Failed to compile shader." << std::endl;
+		GLint info_log_length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+		std::vector< GLchar > info_log(info_log_length, 0);
+		GLsizei length = 0;
+		glGetShaderInfoLog(shader, info_log.size(), &length, &info_log[0]);
+		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
+		glDeleteShader(shader);
+		throw std::runtime_error("Failed to compile shader.");
+	}
+	return shader;
+}
+
+static GLuint link_program(GLuint fragment_shader, GLuint vertex_shader) {
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glLinkProgram(program);
+	GLint link_status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	if (link_status != GL_TRUE) {
+		std::cerr << "Failed to link shader program." << std::endl;
+		GLint info_log_length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+		std::vector< GLchar > info_log(info_log_length, 0);
+		GLsizei length = 0;
+		glGetProgramInfoLog(program, info_log.size(), &length, &info_log[0]);
+		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
+		throw std::runtime_error("Failed to link program");
+	}
+	return program;
+}
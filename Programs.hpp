@@ -0,0 +1,44 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Meshes.hpp"
+#include "Scene.hpp"
+
+//Programs holds the shader program variants used to draw scene objects, one for each of the ways
+// Scene::render() can hand an object its matrices and lights.
+// (the same source is compiled with different #defines for each variant)
+
+struct Programs {
+	//compile and link every variant (needs a current OpenGL context):
+	// note: will throw if compiling or linking fails.
+	Programs();
+
+	//how non-instanced objects get their matrices:
+	enum Mode {
+		MultiDraw, //batched with glMultiDrawElements, matrices from buffer textures
+		UniformBuffer, //one draw each, matrices from a slice of a uniform buffer
+		Uniforms, //one draw each, matrices from plain uniforms
+	};
+	static char const *mode_name(Mode mode);
+
+	//point all of an object's program fields at the variants for 'mode':
+	void set(Scene::Object &object, Mode mode) const;
+
+	//vertex attribute locations (shared by every variant), for Meshes::load:
+	Meshes::Attributes attributes() const;
+
+	//programs, and their attribute and uniform locations:
+	GLuint program = 0;
+	GLuint program_Position = 0;
+	GLuint program_Normal = 0;
+	GLuint program_Color = 0;
+	GLuint program_mvp = 0;
+	GLuint program_itmv = 0;
+	GLuint program_light_list = 0;
+	GLuint instanced_program = 0; //takes mvp and itmv per-instance
+	GLuint matrices_program = 0; //reads mvp and itmv from a "Matrices" uniform block
+	GLuint matrices_program_block = 0;
+	GLuint multidraw_program = 0; //looks up mvp and itmv by MeshIndex, for glMultiDrawElements
+	GLuint multidraw_program_MeshIndex = 0;
+	GLuint multidraw_program_slot_base = 0;
+};
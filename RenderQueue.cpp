@@ -0,0 +1,69 @@
+#include "RenderQueue.hpp"
+#include "Profiler.hpp"
+
+#include <cstring>
+
+uint32_t RenderQueue::intern(std::unordered_map< uint64_t, uint32_t > &ids, uint64_t name) {
+	auto f = ids.find(name);
+	if (f == ids.end()) {
+		f = ids.insert(std::make_pair(name, uint32_t(ids.size()))).first;
+	}
+	return f->second;
+}
+
+uint64_t RenderQueue::make_key(bool blended, uint32_t program_id, uint32_t vao_id, uint32_t mesh_id, float depth) {
+	const uint64_t IdMask = (1U << 12) - 1;
+	const uint64_t MeshMask = (1U << 15) - 1;
+	const uint64_t DepthMask = (1U << 24) - 1;
+
+	//non-negative floats sort the same way as their bit patterns; keep the top 24 (of 31) bits:
+	uint64_t depth_bits = 0;
+	if (depth > 0.0f) {
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		depth_bits = (bits >> 7) & DepthMask;
+	}
+
+	uint64_t state = (uint64_t(program_id & IdMask) << 27) | (uint64_t(vao_id & IdMask) << 15) | (mesh_id & MeshMask);
+	if (!blended) {
+		return (state << 24) | depth_bits;
+	} else {
+		return (uint64_t(1) << 63) | ((DepthMask - depth_bits) << 39) | state;
+	}
+}
+
+void RenderQueue::sort() {
+	PROFILE_ZONE("RenderQueue::sort");
+
+	const uint32_t Passes = 8;
+	uint32_t count = uint32_t(entries.size());
+	if (count < 2) return;
+
+	//histograms for every byte at once:
+	uint32_t histograms[Passes][256];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (auto const &entry : entries) {
+		for (uint32_t pass = 0; pass < Passes; ++pass) {
+			histograms[pass][(entry.key >> (8 * pass)) & 0xff] += 1;
+		}
+	}
+
+	scratch.resize(count);
+	for (uint32_t pass = 0; pass < Passes; ++pass) {
+		uint32_t *histogram = histograms[pass];
+		uint32_t shift = 8 * pass;
+		//every key has the same byte here, so this pass wouldn't change anything:
+		if (histogram[(entries[0].key >> shift) & 0xff] == count) continue;
+
+		uint32_t offsets[256];
+		uint32_t total = 0;
+		for (uint32_t b = 0; b < 256; ++b) {
+			offsets[b] = total;
+			total += histogram[b];
+		}
+		for (auto const &entry : entries) {
+			scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+		}
+		entries.swap(scratch);
+	}
+}
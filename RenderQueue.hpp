@@ -0,0 +1,42 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+//RenderQueue orders draws by 64-bit sort keys, so that draws sharing GL state end up
+// next to each other. Key layout (most significant bits first):
+//   opaque:  0 | program (12) | vao (12) | mesh (15) | depth (24)
+//   blended: 1 | far-to-near depth (24) | program (12) | vao (12) | mesh (15)
+// So opaque draws are grouped by state -- with copies of the same mesh next to each other,
+// ready for instancing -- and go front-to-back within a group (for early-Z);
+// blended draws come after all opaque ones, back-to-front.
+
+struct RenderQueue {
+	struct Entry {
+		uint64_t key;
+		uint32_t index; //which draw this is
+	};
+	std::vector< Entry > entries;
+
+	//'depth' is distance from the camera (negative values are treated as zero):
+	static uint64_t make_key(bool blended, uint32_t program_id, uint32_t vao_id, uint32_t mesh_id, float depth);
+
+	//small ids for GL object names (and meshes, by vao + first vertex), so they fit in keys:
+	// (ids past the key's field width still work, they just don't group as well)
+	uint32_t program_id(GLuint program) { return intern(program_ids, program); }
+	uint32_t vao_id(GLuint vao) { return intern(vao_ids, vao); }
+	uint32_t mesh_id(GLuint vao, GLuint start) { return intern(mesh_ids, (uint64_t(vao) << 32) | start); }
+
+	//sort entries by key (stable radix sort; passes over bytes that are the same in every key are skipped):
+	void sort();
+
+	//internals:
+	std::vector< Entry > scratch;
+	std::unordered_map< uint64_t, uint32_t > program_ids;
+	std::unordered_map< uint64_t, uint32_t > vao_ids;
+	std::unordered_map< uint64_t, uint32_t > mesh_ids;
+	static uint32_t intern(std::unordered_map< uint64_t, uint32_t > &ids, uint64_t name);
+};
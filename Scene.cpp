@@ -1,60 +1,129 @@
 #include "Scene.hpp"
+#include "Profiler.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
-	return glm::mat4( //translate
-		glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		glm::vec4(position, 1.0f)
-	)
-	* glm::mat4_cast(rotation) //rotate
-	* glm::mat4( //scale
-		glm::vec4(scale.x, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, scale.y, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, scale.z, 0.0f),
-		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-	);
+	return to_mat4(make_affine(position, rotation, scale));
 }
 
 glm::mat4 Scene::Transform::make_parent_to_local() const {
-	glm::vec3 inv_scale;
-	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
-	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
-	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
-	return glm::mat4( //un-scale
-		glm::vec4(inv_scale.x, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, inv_scale.y, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, inv_scale.z, 0.0f),
-		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-	)
-	* glm::mat4_cast(glm::inverse(rotation)) //un-rotate
-	* glm::mat4( //un-translate
-		glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		glm::vec4(-position, 1.0f)
-	);
-}
-
-glm::mat4 Scene::Transform::make_local_to_world() const {
-	if (parent) {
-		return parent->make_local_to_world() * make_local_to_parent();
-	} else {
-		return make_local_to_parent();
+	return to_mat4(make_inverse_affine(position, rotation, scale));
+}
+
+void Scene::Transform::mark_dirty() {
+	if (dirty) return; //(so its descendants already are)
+	dirty = true;
+	for (Transform *child = last_child; child; child = child->prev_sibling) {
+		child->mark_dirty();
 	}
 }
 
-glm::mat4 Scene::Transform::make_world_to_local() const {
+bool Scene::Transform::update_cache() const {
+	if (!dirty) return false;
+
+	Affine local_to_parent = make_affine(position, rotation, scale);
+	cached_uniform_scale = (scale.x == scale.y && scale.y == scale.z);
 	if (parent) {
-		return make_parent_to_local() * parent->make_world_to_local();
+		parent->update_cache();
+		cached_local_to_world_affine = multiply(parent->cached_local_to_world_affine, local_to_parent);
+		cached_uniform_scale = cached_uniform_scale && parent->cached_uniform_scale;
 	} else {
-		return make_parent_to_local();
+		cached_local_to_world_affine = local_to_parent;
+	}
+	cached_local_to_world = to_mat4(cached_local_to_world_affine);
+	world_to_local_valid = false; //computed lazily by make_world_to_local()
+	dirty = false;
+	return true;
+}
+
+glm::mat4 const &Scene::Transform::make_local_to_world() const {
+	update_cache();
+	return cached_local_to_world;
+}
+
+Affine const &Scene::Transform::make_local_to_world_affine() const {
+	update_cache();
+	return cached_local_to_world_affine;
+}
+
+Affine const &Scene::Transform::make_world_to_local_affine() const {
+	update_cache();
+	if (!world_to_local_valid) {
+		//invert the cached local_to_world directly (rather than composing inverses up the hierarchy):
+		if (cached_uniform_scale) {
+			cached_world_to_local_affine = invert_similarity(cached_local_to_world_affine);
+		} else {
+			cached_world_to_local_affine = invert(cached_local_to_world_affine);
+		}
+		cached_world_to_local = to_mat4(cached_world_to_local_affine);
+		world_to_local_valid = true;
 	}
+	return cached_world_to_local_affine;
+}
+
+glm::mat4 const &Scene::Transform::make_world_to_local() const {
+	make_world_to_local_affine();
+	return cached_world_to_local;
+}
+
+Scene::Transform::Transform(Transform &&other) noexcept {
+	take_place_of(other);
+}
+
+Scene::Transform &Scene::Transform::operator=(Transform &&other) noexcept {
+	if (this != &other) {
+		//unlink (as in the destructor), then move into other's place:
+		while (last_child) {
+			last_child->set_parent(nullptr);
+		}
+		if (parent) {
+			set_parent(nullptr);
+		}
+		take_place_of(other);
+	}
+	return *this;
+}
+
+void Scene::Transform::take_place_of(Transform &other) {
+	assert(parent == nullptr && last_child == nullptr);
+
+	position = other.position;
+	rotation = other.rotation;
+	scale = other.scale;
+
+	parent = other.parent;
+	last_child = other.last_child;
+	prev_sibling = other.prev_sibling;
+	next_sibling = other.next_sibling;
+	other.parent = other.last_child = other.prev_sibling = other.next_sibling = nullptr;
+
+	//point neighbors at new address:
+	if (prev_sibling) prev_sibling->next_sibling = this;
+	if (next_sibling) next_sibling->prev_sibling = this;
+	else if (parent) parent->last_child = this;
+	for (Transform *child = last_child; child; child = child->prev_sibling) {
+		child->parent = this;
+	}
+
+	//cache is still valid (it doesn't depend on addresses):
+	dirty = other.dirty;
+	world_to_local_valid = other.world_to_local_valid;
+	cached_uniform_scale = other.cached_uniform_scale;
+	cached_local_to_world_affine = other.cached_local_to_world_affine;
+	cached_world_to_local_affine = other.cached_world_to_local_affine;
+	cached_local_to_world = other.cached_local_to_world;
+	cached_world_to_local = other.cached_world_to_local;
+	prepare_stamp = other.prepare_stamp;
+
+	DEBUG_assert_valid_pointers();
 }
 
 void Scene::Transform::DEBUG_assert_valid_pointers() const {
@@ -84,6 +153,7 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 		next_sibling = prev_sibling = nullptr;
 	}
 	parent = new_parent;
+	mark_dirty(); //world matrices (of this and all its descendants) are now stale
 	if (parent) {
 		//add to new parent:
 		if (before) {
@@ -107,40 +177,700 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //---------------------------
 
-void Scene::render() {
-	glm::mat4 world_to_camera = camera.transform.make_world_to_local();
-	glm::mat4 world_to_clip = camera.make_projection() * world_to_camera;
+void Scene::prepare() {
+	PROFILE_ZONE("Scene::prepare");
 
-	//Get world-space position of all lights:
+	Affine const &world_to_camera = camera.transform.make_world_to_local_affine();
+	bool camera_uniform_scale = camera.transform.has_uniform_scale();
+	glm::mat4 world_to_clip = multiply(camera.make_projection(), world_to_camera);
+
+	//camera-space light parameters, for the "Lights" block:
+	lights_block.clip_to_camera = glm::inverse(camera.make_projection());
+	uint32_t light_count = 0;
 	for (auto const &light : lights) {
-		glm::mat4 mv = world_to_camera * light.transform.make_local_to_world();
-		(void)mv;
+		if (light_count == MaxLights) break;
+		Affine mv = multiply(world_to_camera, light.transform.make_local_to_world_affine());
+		auto &out = lights_block.lights[light_count++];
+		if (light.type == Light::Directional) {
+			glm::vec3 to_light = glm::normalize(glm::vec3(mv.rows[0][2], mv.rows[1][2], mv.rows[2][2]));
+			out.position = glm::vec4(to_light, 0.0f);
+		} else {
+			out.position = glm::vec4(mv.rows[0][3], mv.rows[1][3], mv.rows[2][3], 1.0f);
+		}
+		out.intensity = glm::vec4(light.intensity, light.range);
 	}
 
+	//sort every transform that an object depends on by depth:
+	// (each level only reads from the previous ones, so can be updated in parallel)
+	++prepare_stamp;
+	for (auto &level : prepare_levels) {
+		level.clear();
+	}
 	for (auto const &object : objects) {
-		glm::mat4 local_to_world = object.transform.make_local_to_world();
+		uint32_t depth = 0;
+		for (Transform const *t = object.transform.parent; t; t = t->parent) {
+			++depth;
+		}
+		if (depth >= prepare_levels.size()) prepare_levels.resize(depth + 1);
+		for (Transform const *t = &object.transform; t && t->prepare_stamp != prepare_stamp; t = t->parent) {
+			t->prepare_stamp = prepare_stamp;
+			prepare_levels[depth].emplace_back(t);
+			--depth;
+		}
+	}
+
+	const uint32_t Chunk = 256;
+	auto parallel_for = [this](uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn) {
+		if (pool) pool->parallel_for(count, Chunk, fn);
+		else fn(0, count);
+	};
+
+	{ //update transforms, a level at a time:
+		PROFILE_ZONE("transforms");
+		for (auto const &level : prepare_levels) {
+			parallel_for(uint32_t(level.size()), [&level](uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; ++i) {
+					level[i]->update_cache();
+				}
+			});
+		}
+	}
+
+	//world-space bounds of every object:
+	uint32_t count = uint32_t(objects.size());
+	Object *object_array = objects.data();
+	world_boxes.resize(count);
+	world_spheres.resize(count);
+	parallel_for(count, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			Object const &object = object_array[i];
+			if (object.sphere_radius < 0.0f) continue;
+			float const (&m)[3][4] = object.transform.make_local_to_world_affine().rows;
+
+			//sphere: transform center, scale radius by the longest axis:
+			glm::vec3 const &c = object.sphere_center;
+			float scale2 = 0.0f;
+			for (int col = 0; col < 3; ++col) {
+				scale2 = std::max(scale2, m[0][col] * m[0][col] + m[1][col] * m[1][col] + m[2][col] * m[2][col]);
+			}
+			world_spheres[i] = glm::vec4(
+				m[0][0] * c.x + m[0][1] * c.y + m[0][2] * c.z + m[0][3],
+				m[1][0] * c.x + m[1][1] * c.y + m[1][2] * c.z + m[1][3],
+				m[2][0] * c.x + m[2][1] * c.y + m[2][2] * c.z + m[2][3],
+				object.sphere_radius * std::sqrt(scale2));
+
+			//box: transform center, extents through the absolute value of the matrix:
+			glm::vec3 box_center = 0.5f * (object.bbox_min + object.bbox_max);
+			glm::vec3 box_radius = 0.5f * (object.bbox_max - object.bbox_min);
+			BVH::Box &box = world_boxes[i];
+			for (int r = 0; r < 3; ++r) {
+				float center = m[r][0] * box_center.x + m[r][1] * box_center.y + m[r][2] * box_center.z + m[r][3];
+				float radius = std::abs(m[r][0]) * box_radius.x + std::abs(m[r][1]) * box_radius.y + std::abs(m[r][2]) * box_radius.z;
+				box.min[r] = center - radius;
+				box.max[r] = center + radius;
+			}
+		}
+	});
+
+	//keep the BVH in sync -- insert new objects, refit moved ones:
+	stats.moved = 0;
+	stats.rebuilt = 0;
+	uint32_t inserted = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		Object &object = object_array[i];
+		if (object.sphere_radius < 0.0f) {
+			if (object.bvh_leaf != -1U) {
+				bvh.remove(object.bvh_leaf);
+				object.bvh_leaf = -1U;
+			}
+			continue;
+		}
+		if (object.bvh_leaf == -1U) {
+			object.bvh_leaf = bvh.insert(world_boxes[i], objects.handle_at(i).slot);
+			++inserted;
+		} else if (bvh.update(object.bvh_leaf, world_boxes[i])) {
+			++stats.moved;
+		}
+	}
+	bvh.refit();
+	//rebuild after (say) loading a scene, or once refits have made the tree much worse:
+	if ((inserted > 0 && 2 * inserted > bvh.size())
+	 || (stats.moved > 0 && bvh.cost() > 1.5f * bvh_built_cost)) {
+		bvh.build();
+		bvh_built_cost = bvh.cost();
+		stats.rebuilt = 1;
+	}
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+	//cull against view frustum: BVH finds candidates, then check their bounding spheres:
+	visible.assign(count, cull ? 0 : 1);
+	stats.tested = 0;
+	stats.culled = 0;
+	if (cull) {
+		PROFILE_ZONE("cull");
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = world_to_camera * local_to_world;
+		Frustum frustum = Frustum::from_matrix(world_to_clip);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (object_array[i].sphere_radius < 0.0f) visible[i] = 1;
+		}
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+		cull_leaves.clear();
+		bvh.query(frustum, &cull_leaves);
+		cull_indices.clear();
+		for (auto leaf : cull_leaves) {
+			Object const *object = object_for_leaf(leaf);
+			if (object) cull_indices.emplace_back(uint32_t(object - object_array));
+		}
 
-		//set up program uniforms:
-		glUseProgram(object.program);
-		if (object.program_mvp != -1U) {
-			glUniformMatrix4fv(object.program_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+		uint32_t candidates = uint32_t(cull_indices.size());
+		cull_x.resize(candidates);
+		cull_y.resize(candidates);
+		cull_z.resize(candidates);
+		cull_radius.resize(candidates);
+		cull_visible.resize(candidates);
+		parallel_for(candidates, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				glm::vec4 const &sphere = world_spheres[cull_indices[i]];
+				cull_x[i] = sphere.x;
+				cull_y[i] = sphere.y;
+				cull_z[i] = sphere.z;
+				cull_radius[i] = sphere.w;
+			}
+			frustum.test_spheres(end - begin, &cull_x[begin], &cull_y[begin], &cull_z[begin], &cull_radius[begin], &cull_visible[begin]);
+		});
+		for (uint32_t i = 0; i < candidates; ++i) {
+			if (cull_visible[i]) visible[cull_indices[i]] = 1;
 		}
-		if (object.program_itmv != -1U) {
-			glUniformMatrix3fv(object.program_itmv, 1, GL_FALSE, glm::value_ptr(itmv));
+		stats.tested = candidates;
+	}
+
+	//pick lights for visible objects -- every directional light, then the brightest point lights whose
+	// range touches the object's bounds (objects without bounds only get directional lights):
+	light_lists.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		light_lists[i].count = 0;
+	}
+	auto add_light = [](LightList &list, uint32_t index, float weight) {
+		uint32_t slot = list.count;
+		if (slot == MaxObjectLights) {
+			//list is full, so replace the weakest light (if it is weaker than this one):
+			slot = 0;
+			for (uint32_t l = 1; l < MaxObjectLights; ++l) {
+				if (list.weight[l] < list.weight[slot]) slot = l;
+			}
+			if (list.weight[slot] >= weight) return;
+		} else {
+			++list.count;
 		}
+		list.index[slot] = uint8_t(index);
+		list.weight[slot] = weight;
+	};
+	{
+		PROFILE_ZONE("lights");
 
-		glBindVertexArray(object.vao);
+		uint32_t index = 0;
+		for (auto const &light : lights) {
+			if (index == light_count) break;
+			if (light.type == Light::Directional) {
+				for (uint32_t i = 0; i < count; ++i) {
+					if (visible[i]) add_light(light_lists[i], index, std::numeric_limits< float >::infinity());
+				}
+			} else {
+				float const (&m)[3][4] = light.transform.make_local_to_world_affine().rows;
+				glm::vec3 position = glm::vec3(m[0][3], m[1][3], m[2][3]);
+				float brightness = std::max(light.intensity.x, std::max(light.intensity.y, light.intensity.z));
+				light_leaves.clear();
+				bvh.query(position, light.range, &light_leaves);
+				for (auto leaf : light_leaves) {
+					Object const *object = object_for_leaf(leaf);
+					if (!object) continue;
+					uint32_t i = uint32_t(object - object_array);
+					if (!visible[i]) continue;
+					glm::vec4 const &sphere = world_spheres[i];
+					glm::vec3 to_center = glm::vec3(sphere.x, sphere.y, sphere.z) - position;
+					float distance = std::max(0.0f, std::sqrt(glm::dot(to_center, to_center)) - sphere.w);
+					if (distance > light.range) continue;
+					add_light(light_lists[i], index, brightness / std::max(distance * distance, 1e-4f));
+				}
+			}
+			++index;
+		}
+	}
 
-		//draw the object:
-		glDrawArrays(GL_TRIANGLES, object.start, object.count);
+	PROFILE_ZONE("draws"); //(until the end of prepare)
+
+	//levels of detail compare each level's error, projected like a bounding sphere (size / distance), to lod_error:
+	float const (&eye_rows)[3][4] = camera.transform.make_local_to_world_affine().rows;
+	glm::vec3 eye = glm::vec3(eye_rows[0][3], eye_rows[1][3], eye_rows[2][3]);
+	float height_at_distance_1 = 2.0f * std::tan(0.5f * camera.fovy); //(world units covered by the viewport's height)
+
+	draws.clear();
+	draws.reserve(count);
+	stats.simplified = 0;
+	stats.triangles = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!visible[i]) {
+			++stats.culled;
+			continue;
+		}
+		Object &object = object_array[i];
+		if (object.count == 0) continue; //(nothing to draw -- e.g., its mesh is still loading)
+		Draw draw;
+		draw.object = &object;
+		draw.start = object.start;
+		draw.count = object.count;
+		if (lods && object.lod_count > 0 && object.sphere_radius > 0.0f) {
+			glm::vec4 const &sphere = world_spheres[i];
+			float distance = std::max(glm::length(glm::vec3(sphere) - eye) - sphere.w, camera.near);
+			//(object-space error to fraction of the viewport's height)
+			float to_viewport = (sphere.w / object.sphere_radius) / (distance * height_at_distance_1);
+			uint32_t lod_count = std::min(object.lod_count, uint32_t(Object::MaxLODs));
+			uint32_t lod = std::min(object.lod, lod_count);
+			while (lod > 0 && object.lods[lod - 1].error * to_viewport > lod_error) --lod;
+			while (lod < lod_count && object.lods[lod].error * to_viewport <= lod_hysteresis * lod_error) ++lod;
+			object.lod = lod;
+			if (lod > 0) {
+				draw.start = object.lods[lod - 1].start;
+				draw.count = object.lods[lod - 1].count;
+				++stats.simplified;
+			}
+		}
+		stats.triangles += draw.count / 3;
+		draw.program_id = queue.program_id(object.program);
+		draw.vao_id = queue.vao_id(object.vao);
+		draw.mesh_id = queue.mesh_id(object.vao, draw.start);
+		draws.emplace_back(draw);
 	}
+	stats.drawn = uint32_t(draws.size());
+
+	queue.entries.resize(draws.size());
+	parallel_for(uint32_t(draws.size()), [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			Draw &draw = draws[i];
+			Affine const &local_to_world = draw.object->transform.make_local_to_world_affine();
+
+			//compute modelview+projection (object space to clip space) matrix for this object:
+			draw.mvp = multiply(world_to_clip, local_to_world);
+			//...starting from the (possibly quantized) Position attribute, i.e., mvp * translate(offset) * scale(scale):
+			glm::vec3 const &scale = draw.object->dequantize_scale;
+			glm::vec3 const &offset = draw.object->dequantize_offset;
+			draw.mvp[3] += draw.mvp[0] * offset.x + draw.mvp[1] * offset.y + draw.mvp[2] * offset.z;
+			draw.mvp[0] *= scale.x;
+			draw.mvp[1] *= scale.y;
+			draw.mvp[2] *= scale.z;
+
+			//compute modelview (object space to camera local space) matrix for this object:
+			Affine mv = multiply(world_to_camera, local_to_world);
+
+			//normal matrix, inverse(transpose(mv)) -- which is just mv over its squared scale
+			// unless there is non-uniform scale involved:
+			if (camera_uniform_scale && draw.object->transform.has_uniform_scale()) {
+				draw.itmv = normal_matrix_similarity(mv);
+			} else {
+				draw.itmv = normal_matrix(mv);
+			}
+
+			//pack light list, one byte per light:
+			LightList const &list = light_lists[draw.object - object_array];
+			draw.lights[0] = draw.lights[1] = 0;
+			for (uint32_t l = 0; l < list.count; ++l) {
+				draw.lights[l / 4] |= uint32_t(list.index[l] + 1) << (8 * (l % 4));
+			}
+
+			//sort by state, then by depth of the object's origin (camera looks down -z):
+			queue.entries[i].key = RenderQueue::make_key(draw.object->blended, draw.program_id, draw.vao_id, draw.mesh_id, -mv.rows[2][3]);
+			queue.entries[i].index = i;
+		}
+	});
+	queue.sort();
+}
+
+void Scene::render() {
+	PROFILE_ZONE("Scene::render");
+
+	prepare();
+	submit();
+}
+
+void Scene::submit() {
+	if (matrices_stride == 0) {
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = std::max(alignment, 1);
+		matrices_stride = uint32_t((sizeof(MatricesBlock) + alignment - 1) / alignment * alignment);
+	}
+	if (max_texture_buffer_texels == 0) {
+		GLint texels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+		max_texture_buffer_texels = uint32_t(std::max(texels, 65536)); //(the least any GL 3.1 driver allows)
+	}
+	uint32_t const MatricesTexels = sizeof(MatricesBlock) / sizeof(glm::vec4);
+
+	//split the queue into runs, one per draw call:
+	// copies of a mesh are adjacent in the queue, so runs of them become instanced draws;
+	// other neighbouring draws from the same VAO are batched into multi-draws if they can be.
+	instances.clear();
+	matrices.clear();
+	multidraw_offsets.clear();
+	multidraw_counts.clear();
+	multidraw_matrices.clear();
+	multidraw_seen.assign(multidraw_seen.size(), -1U);
+	multidraw_pages.clear();
+	uint32_t run_min_mesh = 0, run_max_mesh = 0; //MeshIndex range of the last run (if it is a multi-draw)
+	runs.clear();
+	uint32_t count = uint32_t(queue.entries.size());
+	for (uint32_t begin = 0; begin < count; ) {
+		Draw const &first_draw = draws[queue.entries[begin].index];
+		Object const &first = *first_draw.object;
+		uint32_t end = begin + 1;
+		if (first.instanced_program != 0) {
+			while (end < count) {
+				Draw const &draw = draws[queue.entries[end].index];
+				Object const &object = *draw.object;
+				if (object.instanced_program != first.instanced_program
+				 || object.vao != first.vao || draw.start != first_draw.start || draw.count != first_draw.count) break;
+				++end;
+			}
+		}
+		if (first.instanced_program != 0 && end - begin >= min_instances) {
+			Run run;
+			run.begin = begin;
+			run.end = end;
+			run.first_instance = uint32_t(instances.size());
+			run.matrices_offset = -1U;
+			run.first_multidraw = -1U;
+			for (uint32_t i = begin; i < end; ++i) {
+				Draw const &draw = draws[queue.entries[i].index];
+				Instance instance;
+				instance.mvp = draw.mvp;
+				instance.itmv = draw.itmv;
+				instance.lights[0] = draw.lights[0];
+				instance.lights[1] = draw.lights[1];
+				instances.emplace_back(instance);
+			}
+			runs.emplace_back(run);
+		} else {
+			for (uint32_t i = begin; i < end; ++i) {
+				Draw const &draw = draws[queue.entries[i].index];
+				Object const &object = *draw.object;
+
+				if (object.multidraw_program != 0 && object.mesh_index != -1U) {
+					uint32_t mesh = object.mesh_index;
+					//each mesh can only be in a multi-draw once, since MeshIndex picks its matrices:
+					if (mesh >= multidraw_seen.size()) multidraw_seen.resize(mesh + 1, -1U);
+					//a multi-draw's slot table covers its lowest to highest MeshIndex, and has to fit in its page
+					// (as do the page's matrices), since both are read through buffer textures:
+					uint32_t span = 1;
+					bool extend = false;
+					if (!runs.empty() && runs.back().first_multidraw != -1U) {
+						Run const &run = runs.back();
+						Object const &batch = *draws[queue.entries[run.begin].index].object;
+						MultiDrawPage const &page = multidraw_pages.back();
+						uint32_t old_span = run_max_mesh - run_min_mesh + 1;
+						span = std::max(run_max_mesh, mesh) - std::min(run_min_mesh, mesh) + 1;
+						extend = (batch.multidraw_program == object.multidraw_program && batch.vao == object.vao
+						       && multidraw_seen[mesh] != runs.size() - 1
+						       && span <= 4 * (run.end - run.begin + 1) + 32 //(don't let sparse indices bloat the table)
+						       && page.slot_count - old_span + span <= max_texture_buffer_texels
+						       && (page.matrices_count + 1) * MatricesTexels <= max_texture_buffer_texels);
+						if (extend) {
+							multidraw_pages.back().slot_count += span - old_span;
+						}
+					}
+					if (!extend) {
+						if (multidraw_pages.empty()
+						 || multidraw_pages.back().slot_count + 1 > max_texture_buffer_texels
+						 || (multidraw_pages.back().matrices_count + 1) * MatricesTexels > max_texture_buffer_texels) {
+							MultiDrawPage page;
+							page.first_matrices = uint32_t(multidraw_matrices.size());
+							page.matrices_count = 0;
+							page.first_slot = (multidraw_pages.empty() ? 0 : multidraw_pages.back().first_slot + multidraw_pages.back().slot_count);
+							page.slot_count = 0;
+							multidraw_pages.emplace_back(page);
+						}
+						multidraw_pages.back().slot_count += 1;
+						run_min_mesh = run_max_mesh = mesh;
+
+						Run run;
+						run.begin = i;
+						run.end = i;
+						run.first_instance = -1U;
+						run.matrices_offset = -1U;
+						run.first_multidraw = uint32_t(multidraw_offsets.size());
+						run.page = uint32_t(multidraw_pages.size() - 1);
+						run.slot_base = 0;
+						runs.emplace_back(run);
+					}
+					run_min_mesh = std::min(run_min_mesh, mesh);
+					run_max_mesh = std::max(run_max_mesh, mesh);
+					multidraw_pages.back().matrices_count += 1;
+					runs.back().end = i + 1;
+					multidraw_seen[object.mesh_index] = uint32_t(runs.size() - 1);
+					multidraw_offsets.emplace_back((GLbyte const *)0 + sizeof(GLuint) * draw.start);
+					multidraw_counts.emplace_back(draw.count);
+					MatricesBlock block;
+					block.mvp = draw.mvp;
+					for (int c = 0; c < 3; ++c) {
+						block.itmv[c] = glm::vec4(draw.itmv[c], 0.0f);
+					}
+					block.lights[0] = draw.lights[0];
+					block.lights[1] = draw.lights[1];
+					block.padding[0] = block.padding[1] = 0;
+					multidraw_matrices.emplace_back(block);
+					continue;
+				}
+
+				Run run;
+				run.begin = i;
+				run.end = i + 1;
+				run.first_instance = -1U;
+				run.matrices_offset = -1U;
+				run.first_multidraw = -1U;
+				if (object.program_matrices != -1U) {
+					MatricesBlock block;
+					block.mvp = draw.mvp;
+					for (int c = 0; c < 3; ++c) {
+						block.itmv[c] = glm::vec4(draw.itmv[c], 0.0f);
+					}
+					block.lights[0] = draw.lights[0];
+					block.lights[1] = draw.lights[1];
+					block.padding[0] = block.padding[1] = 0;
+					run.matrices_offset = uint32_t(matrices.size());
+					matrices.resize(matrices.size() + matrices_stride);
+					std::memcpy(&matrices[run.matrices_offset], &block, sizeof(block));
+				}
+				runs.emplace_back(run);
+			}
+		}
+		begin = end;
+	}
+
+	//slot tables for multi-draws, to find each vertex's matrices (in its page) from its MeshIndex:
+	multidraw_slots.clear();
+	for (auto &run : runs) {
+		if (run.first_multidraw == -1U) continue;
+		MultiDrawPage const &page = multidraw_pages[run.page];
+		uint32_t min_mesh = -1U, max_mesh = 0;
+		for (uint32_t i = run.begin; i < run.end; ++i) {
+			uint32_t mesh = draws[queue.entries[i].index].object->mesh_index;
+			min_mesh = std::min(min_mesh, mesh);
+			max_mesh = std::max(max_mesh, mesh);
+		}
+		uint32_t first = uint32_t(multidraw_slots.size());
+		run.slot_base = int32_t(first - page.first_slot) - int32_t(min_mesh);
+		multidraw_slots.resize(first + (max_mesh - min_mesh + 1), 0);
+		for (uint32_t i = run.begin; i < run.end; ++i) {
+			multidraw_slots[first + (draws[queue.entries[i].index].object->mesh_index - min_mesh)] = run.first_multidraw + (i - run.begin) - page.first_matrices;
+		}
+	}
+
+	//multi-draw tables are uploaded a page at a time, and stay bound as buffer textures until the next page:
+	uint32_t uploaded_page = -1U;
+	auto upload_page = [&](uint32_t index) {
+		auto upload = [](GLuint unit, GLenum format, void const *data, size_t size, GLuint *buffer, GLuint *texture) {
+			bool created = (*buffer == 0);
+			if (created) {
+				glGenBuffers(1, buffer);
+				glGenTextures(1, texture);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, *buffer);
+			glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(GL_TEXTURE_BUFFER, *texture);
+			if (created) glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+		};
+		MultiDrawPage const &page = multidraw_pages[index];
+		upload(MultiDrawMatricesUnit, GL_RGBA32F, &multidraw_matrices[page.first_matrices], sizeof(MatricesBlock) * page.matrices_count, &multidraw_matrices_buffer, &multidraw_matrices_texture);
+		upload(MultiDrawSlotsUnit, GL_R32UI, &multidraw_slots[page.first_slot], sizeof(uint32_t) * page.slot_count, &multidraw_slots_buffer, &multidraw_slots_texture);
+		glActiveTexture(GL_TEXTURE0);
+		uploaded_page = index;
+	};
+
+	{ //upload per-frame data:
+		PROFILE_ZONE("upload");
+		//upload lights for the frame:
+		if (!runs.empty()) {
+			if (lights_buffer == 0) glGenBuffers(1, &lights_buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), &lights_block, GL_STREAM_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, LightsBinding, lights_buffer);
+		}
+
+		//upload all per-instance data for the frame at once:
+		if (!instances.empty()) {
+			if (instance_buffer == 0) glGenBuffers(1, &instance_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * instances.size(), &instances[0], GL_STREAM_DRAW);
+		}
+		//...and all "Matrices" blocks, too:
+		// (only one block's worth is bound at a time, so this can be bigger than GL_MAX_UNIFORM_BLOCK_SIZE)
+		if (!matrices.empty()) {
+			if (matrices_buffer == 0) glGenBuffers(1, &matrices_buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, matrices_buffer);
+			glBufferData(GL_UNIFORM_BUFFER, matrices.size(), &matrices[0], GL_STREAM_DRAW);
+		}
+		//...and the first page of the multi-draw tables (usually the only one):
+		if (!multidraw_pages.empty()) upload_page(0);
+	}
+
+	PROFILE_ZONE("submit"); //(until the end of render)
+
+	//GL state as of the previous draw, to skip redundant changes:
+	GLuint current_program = -1U;
+	GLuint current_vao = -1U;
+	uint32_t const *uploaded_lights = nullptr; //lights in the current program's uniform
+	stats.state_changes = 0;
+	stats.state_changes_saved = 0;
+	stats.uniform_uploads = 0;
+	stats.draw_calls = 0;
+	stats.instanced = 0;
+	stats.multidrawn = 0;
+
+	auto use_program = [&](GLuint program) {
+		if (program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+			uploaded_lights = nullptr;
+			++stats.state_changes;
+		} else {
+			++stats.state_changes_saved;
+		}
+	};
+	auto bind_vao = [&](GLuint vao) {
+		if (vao != current_vao) {
+			glBindVertexArray(vao);
+			current_vao = vao;
+			++stats.state_changes;
+		} else {
+			++stats.state_changes_saved;
+		}
+	};
+
+	for (auto const &run : runs) {
+		Draw const &draw = draws[queue.entries[run.begin].index];
+		Object const &object = *draw.object;
+
+		if (run.first_instance != -1U) {
+			use_program(object.instanced_program);
+			bind_vao(object.vao);
+
+			//point the per-instance attributes at this run's slice of instance_buffer:
+			// (this changes the shared VAO's state, so it is put back after the draw)
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			GLbyte const *base = (GLbyte const *)0 + sizeof(Instance) * run.first_instance;
+			for (GLuint c = 0; c < 4; ++c) {
+				glVertexAttribPointer(InstanceMVPLocation + c, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), base + sizeof(glm::vec4) * c);
+				glVertexAttribDivisor(InstanceMVPLocation + c, 1);
+				glEnableVertexAttribArray(InstanceMVPLocation + c);
+			}
+			for (GLuint c = 0; c < 3; ++c) {
+				glVertexAttribPointer(InstanceITMVLocation + c, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), base + sizeof(glm::mat4) + sizeof(glm::vec3) * c);
+				glVertexAttribDivisor(InstanceITMVLocation + c, 1);
+				glEnableVertexAttribArray(InstanceITMVLocation + c);
+			}
+			glVertexAttribIPointer(InstanceLightsLocation, 2, GL_UNSIGNED_INT, sizeof(Instance), base + sizeof(glm::mat4) + sizeof(glm::mat3));
+			glVertexAttribDivisor(InstanceLightsLocation, 1);
+			glEnableVertexAttribArray(InstanceLightsLocation);
+
+			glDrawElementsInstanced(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, (GLbyte const *)0 + sizeof(GLuint) * draw.start, run.end - run.begin);
+			stats.instanced += run.end - run.begin;
+
+			//...so later non-instanced draws from this VAO don't fetch from (or step through) stale per-instance arrays:
+			for (GLuint c = 0; c < 4; ++c) {
+				glDisableVertexAttribArray(InstanceMVPLocation + c);
+				glVertexAttribDivisor(InstanceMVPLocation + c, 0);
+			}
+			for (GLuint c = 0; c < 3; ++c) {
+				glDisableVertexAttribArray(InstanceITMVLocation + c);
+				glVertexAttribDivisor(InstanceITMVLocation + c, 0);
+			}
+			glDisableVertexAttribArray(InstanceLightsLocation);
+			glVertexAttribDivisor(InstanceLightsLocation, 0);
+		} else if (run.first_multidraw != -1U) {
+			use_program(object.multidraw_program);
+			bind_vao(object.vao);
+
+			if (run.page != uploaded_page) upload_page(run.page);
+			if (object.multidraw_program_slot_base != -1U) {
+				glUniform1i(object.multidraw_program_slot_base, GLint(run.slot_base));
+				++stats.uniform_uploads;
+			}
+
+			glMultiDrawElements(GL_TRIANGLES, &multidraw_counts[run.first_multidraw], GL_UNSIGNED_INT, &multidraw_offsets[run.first_multidraw], run.end - run.begin);
+			stats.multidrawn += run.end - run.begin;
+		} else {
+			use_program(object.program);
+
+			if (run.matrices_offset != -1U) {
+				//point the program's "Matrices" block at this draw's slice of matrices_buffer:
+				glBindBufferRange(GL_UNIFORM_BUFFER, MatricesBinding, matrices_buffer, run.matrices_offset, sizeof(MatricesBlock));
+				++stats.uniform_uploads;
+			}
+
+			//set up program uniforms:
+			// (matrices differ from object to object, so they are always sent; lights often repeat, so are skipped if unchanged)
+			if (run.matrices_offset == -1U && object.program_mvp != -1U) {
+				glUniformMatrix4fv(object.program_mvp, 1, GL_FALSE, glm::value_ptr(draw.mvp));
+				++stats.uniform_uploads;
+			}
+			if (run.matrices_offset == -1U && object.program_itmv != -1U) {
+				glUniformMatrix3fv(object.program_itmv, 1, GL_FALSE, glm::value_ptr(draw.itmv));
+				++stats.uniform_uploads;
+			}
+			if (run.matrices_offset == -1U && object.program_lights != -1U) {
+				if (!(uploaded_lights && uploaded_lights[0] == draw.lights[0] && uploaded_lights[1] == draw.lights[1])) {
+					glUniform2uiv(object.program_lights, 1, draw.lights);
+					uploaded_lights = draw.lights;
+					++stats.uniform_uploads;
+				}
+			}
+
+			bind_vao(object.vao);
+
+			//draw the object:
+			glDrawElements(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, (GLbyte const *)0 + sizeof(GLuint) * draw.start);
+		}
+		++stats.draw_calls;
+	}
+}
+
+//---------------------------
+
+void Scene::remove_object(ObjectHandle handle) {
+	Object &object = objects[handle];
+	if (object.bvh_leaf != -1U) {
+		bvh.remove(object.bvh_leaf);
+	}
+	objects.erase(handle);
+}
+
+Scene::Object const *Scene::object_for_leaf(uint32_t leaf) const {
+	Object const *object = objects.get(objects.handle_in_slot(bvh.value(leaf)));
+	return (object && object->bvh_leaf == leaf ? object : nullptr);
+}
+
+void Scene::append_handles(std::vector< uint32_t > const &leaves, std::vector< ObjectHandle > *out) const {
+	assert(out);
+	for (auto leaf : leaves) {
+		if (object_for_leaf(leaf)) {
+			out->emplace_back(objects.handle_in_slot(bvh.value(leaf)));
+		}
+	}
+}
+
+void Scene::query(BVH::Box const &box, std::vector< ObjectHandle > *out) const {
+	std::vector< uint32_t > leaves;
+	bvh.query(box, &leaves);
+	append_handles(leaves, out);
+}
+
+void Scene::query(glm::vec3 const &center, float radius, std::vector< ObjectHandle > *out) const {
+	std::vector< uint32_t > leaves;
+	bvh.query(center, radius, &leaves);
+	append_handles(leaves, out);
+}
+
+void Scene::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< ObjectHandle > *out) const {
+	std::vector< uint32_t > leaves;
+	bvh.query_ray(origin, direction, max_t, &leaves);
+	append_handles(leaves, out);
 }
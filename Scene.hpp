@@ -1,10 +1,18 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Affine.hpp"
+#include "ThreadPool.hpp"
+#include "SlotMap.hpp"
+#include "Frustum.hpp"
+#include "BVH.hpp"
+#include "RenderQueue.hpp"
+
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <vector>
 #include <list>
+#include <cstdint>
 
 #undef near
 
@@ -13,6 +21,9 @@ struct Scene {
 	struct Transform {
 		Transform() = default;
 		Transform(Transform &) = delete;
+		//moving keeps hierarchy pointers consistent (neighbors are pointed at the new address):
+		Transform(Transform &&other) noexcept;
+		Transform &operator=(Transform &&other) noexcept;
 		~Transform() {
 			while (last_child) {
 				last_child->set_parent(nullptr);
@@ -23,9 +34,13 @@ struct Scene {
 		}
 
 		//simple specification:
+		// (change these with the setters below -- or call mark_dirty() after assigning them -- so cached world matrices are rebuilt)
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
 		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		void set_position(glm::vec3 const &to) { position = to; mark_dirty(); }
+		void set_rotation(glm::quat const &to) { rotation = to; mark_dirty(); }
+		void set_scale(glm::vec3 const &to) { scale = to; mark_dirty(); }
 
 		//hierarchy information:
 		Transform *parent = nullptr;
@@ -40,11 +55,38 @@ struct Scene {
 		//helper that checks local pointer consistency:
 		void DEBUG_assert_valid_pointers() const;
 
+		//helper for move construction/assignment (leaves 'other' unlinked):
+		void take_place_of(Transform &other);
+
 		//computed from the above:
 		glm::mat4 make_local_to_parent() const;
 		glm::mat4 make_parent_to_local() const;
-		glm::mat4 make_local_to_world() const;
-		glm::mat4 make_world_to_local() const;
+		//world matrices are cached, so repeated calls are cheap:
+		glm::mat4 const &make_local_to_world() const;
+		glm::mat4 const &make_world_to_local() const;
+		//same, as Affine (for use with the kernels in Affine.hpp):
+		Affine const &make_local_to_world_affine() const;
+		Affine const &make_world_to_local_affine() const;
+		//true if this transform and all of its ancestors have uniform scale, so local_to_world
+		// is a rotation times a uniform scale (plus translation) and is cheap to invert:
+		bool has_uniform_scale() const { update_cache(); return cached_uniform_scale; }
+
+		//cache for the world matrices:
+		// mark_dirty() flags this transform and everything below it (a dirty transform's descendants are
+		// always dirty too, so it stops at subtrees that already are); update_cache() rebuilds only when flagged,
+		// so cached lookups are O(1) and -- once prepare() has updated a parent -- never write to it again.
+		void mark_dirty();
+		bool update_cache() const; //returns true if local_to_world was rebuilt
+		mutable bool dirty = true;
+		mutable bool world_to_local_valid = false;
+		mutable bool cached_uniform_scale = true;
+		mutable Affine cached_local_to_world_affine;
+		mutable Affine cached_world_to_local_affine;
+		mutable glm::mat4 cached_local_to_world;
+		mutable glm::mat4 cached_world_to_local;
+
+		//used by Scene::prepare() to visit each transform once per frame:
+		mutable uint32_t prepare_stamp = 0;
 	};
 	struct Camera {
 		Transform transform;
@@ -57,24 +99,245 @@ struct Scene {
 	};
 	struct Object {
 		Transform transform;
-		//geometric info:
+		//geometric info (a range of the VAO's GL_UNSIGNED_INT element buffer, as in Mesh):
 		GLuint vao = 0;
-		GLuint start = 0;
-		GLuint count = 0;
+		GLuint start = 0; //first index
+		GLuint count = 0; //number of indices
+		//bounding volumes (in object space, generally copied from the Mesh):
+		glm::vec3 bbox_min = glm::vec3(0.0f);
+		glm::vec3 bbox_max = glm::vec3(0.0f);
+		glm::vec3 sphere_center = glm::vec3(0.0f);
+		float sphere_radius = -1.0f; //negative means "unknown" (never culled)
+		//maps the Position attribute to object space (generally copied from the Mesh, see Mesh::dequantize_scale):
+		glm::vec3 dequantize_scale = glm::vec3(1.0f);
+		glm::vec3 dequantize_offset = glm::vec3(0.0f);
+		//coarser levels of detail (generally copied from the Mesh, see Mesh::lods) -- prepare() draws one of these
+		// instead of start/count when its error would be small enough on screen (see Scene::lod_error):
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			float error = 0.0f; //(object-space distance)
+		};
+		enum : uint32_t { MaxLODs = 3 };
+		LOD lods[MaxLODs];
+		uint32_t lod_count = 0;
+		uint32_t lod = 0; //level drawn last time (0 is start/count, 1 is lods[0], ...; managed by Scene::prepare())
+		//leaf in Scene::bvh (managed by Scene::prepare()):
+		uint32_t bvh_leaf = -1U;
 		//program info:
 		GLuint program = 0;
 		GLuint program_mvp = -1U; //uniform index for MVP matrix
 		GLuint program_itmv = -1U; //uniform index for inverse(transpose(mv)) matrix
+		GLuint program_lights = -1U; //uniform index for the light list (uvec2, see MaxObjectLights)
+		//uniform block index for a "Matrices" block (used instead of the three uniforms above if set):
+		// layout(std140) uniform Matrices { mat4 mvp; mat3 itmv; uvec2 light_list; };
+		// (the program should have the block bound to MatricesBinding)
+		GLuint program_matrices = -1U;
+		//variant of 'program' that takes mvp, itmv, and lights as per-instance attributes
+		// (at InstanceMVPLocation, InstanceITMVLocation, and InstanceLightsLocation), or 0 if there is none:
+		GLuint instanced_program = 0;
+		//variant of 'program' that can draw several different meshes from the same VAO in one
+		// glMultiDrawElements call, or 0 if there is none. It looks up each vertex's matrices through
+		// the MeshIndex attribute (see Meshes::Attributes):
+		//   uniform samplerBuffer (on MultiDrawMatricesUnit): eight RGBA texels per draw, laid out
+		//     like the "Matrices" block (the lights are in the last texel, as float bits);
+		//   uniform usamplerBuffer (on MultiDrawSlotsUnit): draw for slot_base + MeshIndex;
+		GLuint multidraw_program = 0;
+		GLuint multidraw_program_slot_base = -1U; //uniform index for the batch's slot_base
+		GLuint mesh_index = -1U; //MeshIndex of the mesh's vertices (generally copied from the Mesh)
+		//blended objects are drawn after opaque ones, back-to-front:
+		bool blended = false;
+	};
+
+	//attribute locations used for per-instance data by instanced programs:
+	// mvp takes four locations (one per column), itmv takes three.
+	enum : GLuint {
+		InstanceMVPLocation = 4,
+		InstanceITMVLocation = 8,
+		InstanceLightsLocation = 11,
+	};
+	//uniform buffer binding points for "Matrices" and "Lights" blocks:
+	enum : GLuint {
+		MatricesBinding = 0,
+		LightsBinding = 1,
+	};
+	//texture units for the buffer textures multi-draw programs read:
+	enum : GLuint {
+		MultiDrawMatricesUnit = 0,
+		MultiDrawSlotsUnit = 1,
 	};
 	struct Light {
 		Transform transform;
-		//light parameters (directional):
-		glm::vec3 intensity = glm::vec3(1.0f, 1.0f, 1.0f); //effectively, color
+		//directional lights shine down their local -z axis; point lights shine from their origin:
+		enum Type : uint8_t { Directional, Point } type = Directional;
+		glm::vec3 intensity = glm::vec3(1.0f, 1.0f, 1.0f); //effectively, color (point lights: at distance 1)
+		float range = 10.0f; //(point lights) objects farther away than this aren't lit
+	};
+	//render() passes lights to programs in one uniform block, bound to LightsBinding:
+	//  struct Light { vec4 position; vec4 intensity; };
+	//  layout(std140) uniform Lights { mat4 clip_to_camera; Light lights[MAX_LIGHTS]; };
+	// position is in camera space: (direction to light, 0) for directional lights, (position, 1) for
+	// point lights; intensity.w is range. clip_to_camera is there for finding camera-space positions.
+	//Each draw gets a list of the (up to MaxObjectLights) brightest lights that touch its bounds,
+	// packed into a uvec2 one byte per light: light index + 1, ending at the first zero.
+	// (only the first MaxLights lights are used)
+	enum : uint32_t {
+		MaxLights = 255,
+		MaxObjectLights = 8,
 	};
 
 	Camera camera;
-	std::list< Object > objects;
+	//objects are kept densely packed, and referred to by (stable) handles:
+	// note: adding or removing objects may move them, so don't hold Object pointers.
+	typedef SlotMap< Object >::Handle ObjectHandle;
+	SlotMap< Object > objects;
 	std::list< Light > lights;
 
+	//remove an object:
+	// (use this rather than objects.erase() so the object is also removed from 'bvh')
+	void remove_object(ObjectHandle handle);
+
+	//objects with known bounds are kept in a BVH over their world-space boxes;
+	// prepare() inserts new objects, refits moved ones, and rebuilds when quality drops:
+	BVH bvh;
+
+	//objects whose bounds touch a box / sphere / ray, as of the last prepare():
+	// (conservative by up to bvh.margin)
+	void query(BVH::Box const &box, std::vector< ObjectHandle > *out) const;
+	void query(glm::vec3 const &center, float radius, std::vector< ObjectHandle > *out) const;
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< ObjectHandle > *out) const;
+
+	//if set, prepare() spreads its work over this pool:
+	ThreadPool *pool = nullptr;
+
+	//matrices for each object, computed by prepare() and consumed by render():
+	struct Draw {
+		Object const *object;
+		GLuint start, count; //range of indices to draw (the object's, or one of its levels of detail)
+		glm::mat4 mvp;
+		glm::mat3 itmv;
+		uint32_t lights[2]; //packed light list (see MaxObjectLights)
+		uint32_t program_id; //ids used in sort keys (see RenderQueue)
+		uint32_t vao_id;
+		uint32_t mesh_id;
+	};
+	std::vector< Draw > draws;
+
+	//order in which render() submits 'draws' (sorted by prepare() to minimize state changes):
+	RenderQueue queue;
+
+	//render() draws runs of at least this many copies of a mesh with one instanced draw call
+	// (if the objects have an instanced_program):
+	uint32_t min_instances = 2;
+
+	//if set, prepare() skips objects whose bounding volumes are outside the view frustum:
+	// (the BVH finds candidates, whose bounding spheres are then tested individually)
+	bool cull = true;
+
+	//if set, prepare() draws objects with levels of detail at the coarsest level whose error would cover at most
+	// 'lod_error' of the viewport's height (projecting the level's error like the object's bounding sphere):
+	bool lods = true;
+	float lod_error = 1.0f / 1080.0f; //(about a pixel at 1080p)
+	//...but only switches to a coarser level once its error is below lod_hysteresis * lod_error, so objects
+	// near a threshold don't flicker back and forth between levels:
+	float lod_hysteresis = 0.75f;
+
+	//counters from the last prepare():
+	struct Stats {
+		uint32_t tested = 0; //objects whose bounding spheres were tested against the view frustum
+		uint32_t culled = 0; //objects found to be outside the view frustum
+		uint32_t drawn = 0; //objects in 'draws'
+		uint32_t simplified = 0; //...drawn at a coarser level of detail
+		uint32_t triangles = 0; //...and how many triangles they have in all
+		uint32_t moved = 0; //objects whose BVH leaves had to be updated
+		uint32_t rebuilt = 0; //1 if the BVH was rebuilt
+		//from the last render():
+		uint32_t state_changes = 0; //program and VAO binds
+		uint32_t state_changes_saved = 0; //...skipped because they were redundant
+		uint32_t uniform_uploads = 0; //uniform values set and uniform buffer ranges bound
+		uint32_t draw_calls = 0;
+		uint32_t instanced = 0; //objects drawn as part of instanced draw calls
+		uint32_t multidrawn = 0; //objects drawn as part of multi-draw calls
+	} stats;
+
+	//update world matrices (one hierarchy level at a time), cull, fill in 'draws', and sort 'queue':
+	// (does not touch OpenGL, so it is safe to run with 'pool' helping)
+	void prepare();
+
+	//prepare() and then submit():
 	void render();
+	//upload the per-frame tables and issue draw calls in 'queue' order, as of the last prepare():
+	// (split from render() so callers can time the two halves apart)
+	void submit();
+
+	//internals for prepare():
+	uint32_t prepare_stamp = 0;
+	std::vector< std::vector< Transform const * > > prepare_levels;
+	std::vector< BVH::Box > world_boxes; //per object
+	std::vector< glm::vec4 > world_spheres; //per object (center, radius)
+	std::vector< uint32_t > cull_leaves; //BVH leaves in the view frustum
+	std::vector< uint32_t > cull_indices; //...and the objects they belong to
+	std::vector< float > cull_x, cull_y, cull_z, cull_radius; //bounding spheres of those objects
+	std::vector< uint8_t > cull_visible;
+	std::vector< uint8_t > visible; //per object
+	float bvh_built_cost = 0.0f; //BVH cost right after the last build()
+	struct LightsBlock { //std140 layout of the "Lights" block
+		glm::mat4 clip_to_camera;
+		struct {
+			glm::vec4 position;
+			glm::vec4 intensity;
+		} lights[MaxLights];
+	};
+	LightsBlock lights_block; //(uploaded by render())
+	struct LightList { //the brightest lights touching an object
+		uint32_t count;
+		uint8_t index[MaxObjectLights]; //in lights_block.lights
+		float weight[MaxObjectLights]; //rough brightness at the object, to pick which lights to keep
+	};
+	std::vector< LightList > light_lists; //per object
+	std::vector< uint32_t > light_leaves; //BVH leaves near a point light
+	//internals for render():
+	struct Instance { //per-instance attributes, as stored in instance_buffer
+		glm::mat4 mvp;
+		glm::mat3 itmv;
+		uint32_t lights[2];
+	};
+	std::vector< Instance > instances;
+	struct Run { //range of queue.entries drawn with one call
+		uint32_t begin, end;
+		uint32_t first_instance; //in 'instances', or -1U for a plain draw
+		uint32_t matrices_offset; //in 'matrices', or -1U if uniforms are used
+		uint32_t first_multidraw; //in 'multidraw_*', or -1U if not a multi-draw
+		uint32_t page; //in 'multidraw_pages' (for multi-draws)
+		int32_t slot_base; //added to MeshIndex to find its slot in the page (for multi-draws)
+	};
+	std::vector< Run > runs;
+	GLuint instance_buffer = 0;
+	struct MatricesBlock { //std140 layout of the "Matrices" block
+		glm::mat4 mvp;
+		glm::vec4 itmv[3]; //(mat3 columns are padded to vec4)
+		uint32_t lights[2];
+		uint32_t padding[2];
+	};
+	std::vector< uint8_t > matrices; //one MatricesBlock every matrices_stride bytes
+	uint32_t matrices_stride = 0; //sizeof(MatricesBlock), rounded up to the buffer offset alignment
+	GLuint matrices_buffer = 0;
+	std::vector< GLvoid const * > multidraw_offsets; //per multi-drawn object (element buffer offset of its first index)
+	std::vector< GLsizei > multidraw_counts; //per multi-drawn object
+	std::vector< MatricesBlock > multidraw_matrices; //per multi-drawn object (same layout as the texture buffer)
+	std::vector< uint32_t > multidraw_slots; //per multi-draw, one for each MeshIndex from its lowest to its highest
+	std::vector< uint32_t > multidraw_seen; //per MeshIndex, the last run it was added to
+	struct MultiDrawPage { //slice of the multi-draw tables small enough to fit in the buffer textures
+		uint32_t first_matrices, matrices_count; //in 'multidraw_matrices'
+		uint32_t first_slot, slot_count; //in 'multidraw_slots'
+	};
+	std::vector< MultiDrawPage > multidraw_pages;
+	uint32_t max_texture_buffer_texels = 0; //GL_MAX_TEXTURE_BUFFER_SIZE
+	GLuint multidraw_matrices_buffer = 0, multidraw_matrices_texture = 0;
+	GLuint multidraw_slots_buffer = 0, multidraw_slots_texture = 0;
+	GLuint lights_buffer = 0;
+	//BVH leaf -> object (or nullptr if the leaf is stale):
+	Object const *object_for_leaf(uint32_t leaf) const;
+	//append handles of the objects for some BVH leaves:
+	void append_handles(std::vector< uint32_t > const &leaves, std::vector< ObjectHandle > *out) const;
 };
@@ -0,0 +1,334 @@
+#include "Simplify.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+//sum of w * (dot(n, p) + d)^2 over some planes, as the ten terms of a symmetric 4x4 matrix, plus the total weight:
+// (doubles, since the terms get large and then cancel)
+struct Quadric {
+	double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+	double b2 = 0.0, bc = 0.0, bd = 0.0;
+	double c2 = 0.0, cd = 0.0;
+	double d2 = 0.0;
+	double weight = 0.0;
+
+	void add_plane(glm::vec3 const &n, float d, float w) {
+		a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+		b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+		c2 += w * n.z * n.z; cd += w * n.z * d;
+		d2 += w * d * d;
+		weight += w;
+	}
+	void add(Quadric const &o) {
+		a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+		b2 += o.b2; bc += o.bc; bd += o.bd;
+		c2 += o.c2; cd += o.cd;
+		d2 += o.d2;
+		weight += o.weight;
+	}
+	//root-mean-square distance from p to the planes (area-weighted -- good for ranking collapses, but it
+	// shrinks as planes pile up, so it says little about the worst of them):
+	float error(glm::vec3 const &p) const {
+		if (weight <= 0.0) return 0.0f;
+		double x = p.x, y = p.y, z = p.z;
+		double sum = a2 * x * x + b2 * y * y + c2 * z * z + d2
+		           + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+		return float(std::sqrt(std::max(0.0, sum / weight)));
+	}
+};
+
+void simplify_levels(std::vector< uint32_t > const &indices, glm::vec3 const *positions, uint32_t vertex_count,
+	std::vector< uint32_t > const &targets, float max_error,
+	std::vector< std::vector< uint32_t > > *levels_, std::vector< float > *errors_) {
+	assert(levels_);
+	assert(errors_);
+	std::vector< std::vector< uint32_t > > &levels = *levels_;
+	std::vector< float > &errors = *errors_;
+	levels.clear();
+	errors.clear();
+	assert(indices.size() % 3 == 0);
+
+	//vertices at the same position share a 'corner' (named by the first of them); collapses move corners:
+	std::vector< uint32_t > sorted(vertex_count);
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		sorted[i] = i;
+	}
+	std::sort(sorted.begin(), sorted.end(), [positions](uint32_t a, uint32_t b) {
+		int c = std::memcmp(&positions[a], &positions[b], sizeof(glm::vec3));
+		return c < 0 || (c == 0 && a < b);
+	});
+	std::vector< uint32_t > corner(vertex_count);
+	std::vector< uint32_t > corner_vertices(vertex_count, 0); //vertices sharing each corner
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		bool same = (i > 0 && std::memcmp(&positions[sorted[i]], &positions[sorted[i - 1]], sizeof(glm::vec3)) == 0);
+		corner[sorted[i]] = (same ? corner[sorted[i - 1]] : sorted[i]);
+		++corner_vertices[corner[sorted[i]]];
+	}
+
+	//current triangles (less any that are degenerate to begin with):
+	std::vector< uint32_t > triangles;
+	triangles.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		assert(indices[i] < vertex_count && indices[i + 1] < vertex_count && indices[i + 2] < vertex_count);
+		uint32_t a = corner[indices[i]], b = corner[indices[i + 1]], c = corner[indices[i + 2]];
+		if (a == b || b == c || c == a) continue;
+		triangles.insert(triangles.end(), indices.begin() + i, indices.begin() + i + 3);
+	}
+
+	//each corner's quadric starts as the planes of the triangles around it, weighted by area:
+	std::vector< Quadric > quadrics(vertex_count);
+	//...and each corner also keeps a list of those planes, so the farthest of them can be found:
+	// (lists are linked through 'next_entry', so a collapse appends one corner's list to another's in O(1))
+	std::vector< glm::vec4 > planes; //normal, offset
+	std::vector< uint32_t > entry_plane, next_entry;
+	std::vector< uint32_t > first_entry(vertex_count, -1U), last_entry(vertex_count, -1U);
+	for (size_t i = 0; i < triangles.size(); i += 3) {
+		glm::vec3 const &p0 = positions[triangles[i]];
+		glm::vec3 n = glm::cross(positions[triangles[i + 1]] - p0, positions[triangles[i + 2]] - p0);
+		float length = glm::length(n);
+		if (length == 0.0f) continue;
+		n /= length;
+		float d = -glm::dot(n, p0);
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t c = corner[triangles[i + k]];
+			quadrics[c].add_plane(n, d, 0.5f * length);
+			entry_plane.emplace_back(uint32_t(planes.size()));
+			next_entry.emplace_back(first_entry[c]);
+			if (first_entry[c] == -1U) last_entry[c] = uint32_t(next_entry.size() - 1);
+			first_entry[c] = uint32_t(next_entry.size() - 1);
+		}
+		planes.emplace_back(n, d);
+	}
+	//farthest distance from p to any of the original planes in a corner's list:
+	auto farthest = [&](uint32_t c, glm::vec3 const &p) {
+		float far = 0.0f;
+		for (uint32_t e = first_entry[c]; e != -1U; e = next_entry[e]) {
+			glm::vec4 const &plane = planes[entry_plane[e]];
+			far = std::max(far, std::abs(plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w));
+		}
+		return far;
+	};
+
+	//corners on seams, open borders, or non-manifold edges never move:
+	std::vector< uint8_t > locked(vertex_count, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		if (corner_vertices[corner[v]] > 1) locked[corner[v]] = 1;
+	}
+	{ //(interior edges are used by exactly two triangles)
+		std::vector< uint64_t > edges;
+		edges.reserve(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t a = corner[triangles[i + k]], b = corner[triangles[i + (k + 1) % 3]];
+				edges.emplace_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+			while (end < edges.size() && edges[end] == edges[begin]) ++end;
+			if (end - begin != 2) {
+				locked[uint32_t(edges[begin] >> 32)] = 1;
+				locked[uint32_t(edges[begin])] = 1;
+			}
+		}
+	}
+
+	struct Collapse {
+		float error; //quadric error (to pick the cheapest collapses)
+		float distance; //farthest the moved corner ends up from the original planes around it (to bound the level's error)
+		uint32_t from; //vertex (and corner) that moves
+		uint32_t to; //vertex its triangles use instead
+	};
+	std::vector< Collapse > collapses;
+	//each corner's cheapest collapse stays the same until something next to it moves:
+	std::vector< Collapse > cheapest(vertex_count);
+	std::vector< uint32_t > touched(vertex_count, 0); //last pass that moved (or moved next to) each corner
+	uint32_t pass = 0;
+	std::vector< uint32_t > adjacency_begin, adjacency, cursor; //triangles around each corner
+	std::vector< uint32_t > replace(vertex_count); //where each vertex went in this pass
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		replace[v] = v;
+	}
+	std::vector< uint32_t > neighbours;
+	std::vector< uint32_t > mark(vertex_count, 0), shared_mark(vertex_count, 0);
+	uint32_t stamp = 0, shared_stamp = 0;
+
+	float error = 0.0f; //largest 'distance' of any collapse so far
+	size_t emitted = indices.size(); //size of the last level
+	size_t next = 0; //target being worked toward
+	//each pass finds the cheapest collapse for every corner, then does as many as it can without any overlapping:
+	while (next < targets.size()) {
+		if (triangles.size() <= targets[next]) {
+			if (triangles.size() < emitted) {
+				levels.emplace_back(triangles);
+				errors.emplace_back(error);
+				emitted = triangles.size();
+			}
+			++next;
+			continue;
+		}
+
+		adjacency_begin.assign(vertex_count + 1, 0);
+		for (auto v : triangles) {
+			++adjacency_begin[corner[v] + 1];
+		}
+		for (uint32_t c = 0; c < vertex_count; ++c) {
+			adjacency_begin[c + 1] += adjacency_begin[c];
+		}
+		adjacency.resize(triangles.size());
+		cursor.assign(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (size_t i = 0; i < triangles.size(); ++i) {
+			adjacency[cursor[corner[triangles[i]]]++] = uint32_t(i / 3);
+		}
+		auto around_begin = [&](uint32_t c) { return adjacency.begin() + adjacency_begin[c]; };
+		auto around_end = [&](uint32_t c) { return adjacency.begin() + adjacency_begin[c + 1]; };
+
+		collapses.clear();
+		for (uint32_t u = 0; u < vertex_count; ++u) {
+			//(corners that aren't locked have just the one vertex)
+			if (corner[u] != u || locked[u] || adjacency_begin[u] == adjacency_begin[u + 1]) continue;
+
+			bool stale = (pass == 0);
+			for (auto t = around_begin(u); t != around_end(u) && !stale; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					stale = stale || (touched[corner[triangles[3 * *t + k]]] == pass);
+				}
+			}
+			if (!stale) {
+				if (cheapest[u].distance <= max_error) collapses.emplace_back(cheapest[u]);
+				continue;
+			}
+
+			++stamp;
+			neighbours.clear();
+			for (auto t = around_begin(u); t != around_end(u); ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t c = corner[triangles[3 * *t + k]];
+					if (c != u && mark[c] != stamp) {
+						mark[c] = stamp;
+						neighbours.emplace_back(c);
+					}
+				}
+			}
+
+			Collapse best;
+			best.error = std::numeric_limits< float >::infinity();
+			best.distance = std::numeric_limits< float >::infinity();
+			for (auto v : neighbours) {
+				Quadric quadric = quadrics[u];
+				quadric.add(quadrics[v]);
+				float e = quadric.error(positions[v]);
+				//(an average of the distances is at most the farthest, so this skips hopeless collapses early)
+				if (!(e <= max_error) || e >= best.error) continue;
+
+				//u's triangles will use the vertex at v they already touch (which must be the same one for each):
+				uint32_t to = -1U;
+				bool consistent = true;
+				for (auto t = around_begin(u); t != around_end(u); ++t) {
+					for (uint32_t k = 0; k < 3; ++k) {
+						uint32_t x = triangles[3 * *t + k];
+						if (corner[x] != v) continue;
+						if (to == -1U) to = x;
+						else if (to != x) consistent = false;
+					}
+				}
+				if (!consistent) continue;
+
+				//the edge's ends may only share the two neighbours across it (or the surface would pinch):
+				++shared_stamp;
+				uint32_t shared = 0;
+				for (auto t = around_begin(v); t != around_end(v); ++t) {
+					for (uint32_t k = 0; k < 3; ++k) {
+						uint32_t c = corner[triangles[3 * *t + k]];
+						if (c == u || c == v || shared_mark[c] == shared_stamp) continue;
+						shared_mark[c] = shared_stamp;
+						if (mark[c] == stamp) ++shared;
+					}
+				}
+				if (shared != 2) continue;
+
+				//none of the triangles that remain may flip over:
+				bool flips = false;
+				for (auto t = around_begin(u); t != around_end(u) && !flips; ++t) {
+					glm::vec3 before[3], after[3];
+					bool has_v = false;
+					for (uint32_t k = 0; k < 3; ++k) {
+						uint32_t c = corner[triangles[3 * *t + k]];
+						has_v = has_v || (c == v);
+						before[k] = positions[c];
+						after[k] = (c == u ? positions[v] : before[k]);
+					}
+					if (has_v) continue;
+					glm::vec3 n_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+					glm::vec3 n_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+					flips = (glm::dot(n_before, n_after) <= 0.0f && glm::dot(n_before, n_before) > 0.0f);
+				}
+				if (flips) continue;
+
+				float distance = farthest(u, positions[v]);
+				if (!(distance <= max_error)) continue;
+
+				best.error = e;
+				best.distance = distance;
+				best.from = u;
+				best.to = to;
+			}
+			cheapest[u] = best;
+			if (best.distance <= max_error) collapses.emplace_back(best);
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](Collapse const &a, Collapse const &b) {
+			return a.error < b.error || (a.error == b.error && a.from < b.from);
+		});
+
+		//do the cheapest collapses first; each leaves its neighbourhood alone for the rest of the pass:
+		++pass;
+		size_t remaining = triangles.size();
+		uint32_t applied = 0;
+		for (auto const &collapse : collapses) {
+			if (remaining <= targets[next]) break;
+			uint32_t u = collapse.from;
+			uint32_t v = corner[collapse.to];
+			if (touched[u] == pass || touched[v] == pass) continue;
+			for (auto t = around_begin(u); t != around_end(u); ++t) {
+				bool has_v = false;
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t c = corner[triangles[3 * *t + k]];
+					touched[c] = pass;
+					has_v = has_v || (c == v);
+				}
+				if (has_v) remaining -= 3;
+			}
+			replace[u] = collapse.to;
+			quadrics[v].add(quadrics[u]);
+			if (first_entry[u] != -1U) {
+				if (first_entry[v] == -1U) first_entry[v] = first_entry[u];
+				else next_entry[last_entry[v]] = first_entry[u];
+				last_entry[v] = last_entry[u];
+			}
+			error = std::max(error, collapse.distance);
+			++applied;
+		}
+		if (applied == 0) break;
+
+		//rewrite triangles, dropping the ones that collapsed to edges:
+		size_t out = 0;
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			uint32_t a = replace[triangles[i]], b = replace[triangles[i + 1]], c = replace[triangles[i + 2]];
+			if (corner[a] == corner[b] || corner[b] == corner[c] || corner[c] == corner[a]) continue;
+			triangles[out++] = a;
+			triangles[out++] = b;
+			triangles[out++] = c;
+		}
+		triangles.resize(out);
+	}
+
+	//ran out of collapses short of a target: keep how far it got, if that's worth a level:
+	if (next < targets.size() && triangles.size() <= emitted / 4 * 3) {
+		levels.emplace_back(triangles);
+		errors.emplace_back(error);
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//Mesh simplification, for building levels of detail.
+
+//simplify an indexed triangle list by collapsing edges in order of quadric error (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics"), down to each index count in 'targets' in turn (largest first):
+// - collapses move a vertex onto one of its neighbours, so every level indexes the original vertices;
+// - vertices on open borders or attribute seams (several vertices at one position) never move;
+// - if it runs out of collapses within 'max_error' first, the last level is however far it got
+//   (as long as that saves at least a quarter of the previous level's triangles).
+// Fills 'levels' with the index lists, and 'errors' with how far each may be from the original surface (in position
+// units): the farthest any moved vertex ended up from the plane of any original triangle it replaced -- a maximum, not
+// an average, so it is fit for screen-space error selection.
+// (collapses are still ordered by quadric error, but none is done that would move a vertex farther than 'max_error')
+void simplify_levels(std::vector< uint32_t > const &indices, glm::vec3 const *positions, uint32_t vertex_count,
+	std::vector< uint32_t > const &targets, float max_error,
+	std::vector< std::vector< uint32_t > > *levels, std::vector< float > *errors);
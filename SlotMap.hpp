@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <cassert>
+#include <utility>
+
+//SlotMap stores values contiguously and refers to them with generational handles.
+// - emplace() and erase() are O(1);
+// - erase() moves the last value into the hole ("swap and pop"), so iterating
+//   begin()..end() always walks a dense array (in no particular order);
+// - handles to erased values are detected as stale (get() returns nullptr).
+
+template< typename T >
+struct SlotMap {
+	struct Handle {
+		uint32_t slot = -1U;
+		uint32_t generation = 0;
+		bool operator==(Handle const &other) const { return slot == other.slot && generation == other.generation; }
+		bool operator!=(Handle const &other) const { return !(*this == other); }
+	};
+
+	//add a default-constructed value:
+	Handle emplace() {
+		uint32_t slot = free_slot;
+		if (slot != -1U) {
+			free_slot = slots[slot].index;
+		} else {
+			slot = uint32_t(slots.size());
+			slots.emplace_back();
+		}
+		slots[slot].index = uint32_t(values.size());
+		values.emplace_back();
+		value_slots.emplace_back(slot);
+
+		Handle handle;
+		handle.slot = slot;
+		handle.generation = slots[slot].generation;
+		return handle;
+	}
+
+	//remove a value (and invalidate all handles to it):
+	// note: moves the last value, so pointers/references into the map are invalidated.
+	void erase(Handle handle) {
+		assert(contains(handle));
+		Slot &slot = slots[handle.slot];
+		uint32_t index = slot.index;
+		uint32_t last = uint32_t(values.size()) - 1;
+		if (index != last) {
+			values[index] = std::move(values[last]);
+			value_slots[index] = value_slots[last];
+			slots[value_slots[index]].index = index;
+		}
+		values.pop_back();
+		value_slots.pop_back();
+
+		slot.generation += 1;
+		slot.index = free_slot;
+		free_slot = handle.slot;
+	}
+
+	bool contains(Handle handle) const {
+		return handle.slot < slots.size()
+		    && slots[handle.slot].generation == handle.generation
+		    && slots[handle.slot].index < values.size()
+		    && value_slots[slots[handle.slot].index] == handle.slot;
+	}
+
+	//look up by handle; nullptr if the handle is stale:
+	T *get(Handle handle) { return contains(handle) ? &values[slots[handle.slot].index] : nullptr; }
+	T const *get(Handle handle) const { return contains(handle) ? &values[slots[handle.slot].index] : nullptr; }
+
+	//look up by handle, which must be valid:
+	T &operator[](Handle handle) { assert(contains(handle)); return values[slots[handle.slot].index]; }
+	T const &operator[](Handle handle) const { assert(contains(handle)); return values[slots[handle.slot].index]; }
+
+	//dense iteration:
+	typename std::vector< T >::iterator begin() { return values.begin(); }
+	typename std::vector< T >::iterator end() { return values.end(); }
+	typename std::vector< T >::const_iterator begin() const { return values.begin(); }
+	typename std::vector< T >::const_iterator end() const { return values.end(); }
+	T *data() { return values.data(); }
+	T const *data() const { return values.data(); }
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+
+	//handle for the value at a given dense index:
+	Handle handle_at(uint32_t index) const {
+		Handle handle;
+		handle.slot = value_slots[index];
+		handle.generation = slots[handle.slot].generation;
+		return handle;
+	}
+
+	//handle for the value currently in a given slot (stale if the slot is free):
+	Handle handle_in_slot(uint32_t slot) const {
+		Handle handle;
+		handle.slot = slot;
+		handle.generation = (slot < slots.size() ? slots[slot].generation : 0);
+		return handle;
+	}
+
+	void reserve(size_t count) {
+		values.reserve(count);
+		value_slots.reserve(count);
+		slots.reserve(count);
+	}
+
+	//internals:
+	struct Slot {
+		uint32_t index = -1U; //index into 'values' (or next free slot, for free slots)
+		uint32_t generation = 0;
+	};
+	std::vector< T > values;
+	std::vector< uint32_t > value_slots; //slot that refers to each value
+	std::vector< Slot > slots;
+	uint32_t free_slot = -1U; //head of free list
+};
@@ -0,0 +1,77 @@
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+
+uint32_t ThreadPool::default_workers() {
+	uint32_t hardware = std::thread::hardware_concurrency();
+	return (hardware > 1 ? hardware - 1 : 0);
+}
+
+ThreadPool::ThreadPool(uint32_t count) : next_chunk(0) {
+	workers.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		workers.emplace_back([this]() {
+			uint32_t seen = 0;
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake.wait(lock, [&]() { return quit || generation != seen; });
+				if (quit) break;
+				seen = generation;
+				lock.unlock();
+				run_chunks();
+				lock.lock();
+				//every worker checks in once per job, so 'job' stays valid until all are done:
+				if (--pending == 0) done.notify_one();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run_chunks() {
+	PROFILE_ZONE("ThreadPool::run_chunks");
+
+	while (true) {
+		uint32_t begin = next_chunk.fetch_add(job_chunk);
+		if (begin >= job_count) break;
+		(*job)(begin, std::min(job_count, begin + job_chunk));
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t count, uint32_t chunk, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (count == 0) return;
+	chunk = std::max(chunk, 1U);
+	//not worth waking anyone up:
+	if (workers.empty() || count <= chunk) {
+		fn(0, count);
+		return;
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		job = &fn;
+		job_count = count;
+		job_chunk = chunk;
+		next_chunk = 0;
+		pending = uint32_t(workers.size());
+		++generation;
+	}
+	wake.notify_all();
+
+	run_chunks();
+
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [this]() { return pending == 0; });
+	job = nullptr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//ThreadPool keeps a fixed set of worker threads around for running parallel-for loops.
+
+struct ThreadPool {
+	//'workers' threads are started; the calling thread also helps in parallel_for,
+	// so ThreadPool(0) just runs everything inline:
+	explicit ThreadPool(uint32_t workers = default_workers());
+	ThreadPool(ThreadPool const &) = delete;
+	~ThreadPool();
+
+	//one less than the number of hardware threads:
+	static uint32_t default_workers();
+
+	//call fn(begin, end) on chunks of (at most) 'chunk' elements covering [0, count),
+	// returning once all chunks are done.
+	//note: fn must not throw; it is called from several threads at once.
+	void parallel_for(uint32_t count, uint32_t chunk, std::function< void(uint32_t, uint32_t) > const &fn);
+
+	//total threads that run parallel_for chunks (workers + caller):
+	uint32_t size() const { return uint32_t(workers.size()) + 1; }
+
+	//internals:
+	void run_chunks();
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when a new job is posted (or on quit)
+	std::condition_variable done; //signalled when the last worker checks out of a job
+	std::function< void(uint32_t, uint32_t) > const *job = nullptr;
+	uint32_t job_count = 0;
+	uint32_t job_chunk = 0;
+	std::atomic< uint32_t > next_chunk;
+	uint32_t generation = 0; //incremented for every job
+	uint32_t pending = 0; //workers that haven't finished the current job
+	bool quit = false;
+};
@@ -0,0 +1,210 @@
+#include "TransformStore.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+//rotate 'vec' so that the block [begin, begin+count) ends up starting at 'to'
+// (all indices are before the move, and relative to 'offset'):
+template< typename T >
+static void rotate_block(std::vector< T > &vec, uint32_t begin, uint32_t count, uint32_t to, uint32_t offset = 0) {
+	begin -= offset;
+	to -= offset;
+	auto base = vec.begin();
+	if (to < begin) {
+		std::rotate(base + to, base + begin, base + begin + count);
+	} else if (to > begin + count) {
+		std::rotate(base + begin, base + begin + count, base + to);
+	}
+}
+
+template< typename T >
+static void erase_at(std::vector< T > &vec, uint32_t index) {
+	vec.erase(vec.begin() + index);
+}
+
+uint32_t TransformStore::index_of(Handle handle) const {
+	assert(handle < indices.size() && indices[handle] != -1U);
+	return indices[handle];
+}
+
+TransformStore::Handle TransformStore::get_parent(Handle handle) const {
+	uint32_t index = index_of(handle);
+	return (parents[index] == -1U ? -1U : handles[parents[index]]);
+}
+
+TransformStore::Handle TransformStore::add(Handle parent) {
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	} else {
+		handle = Handle(indices.size());
+		indices.emplace_back(-1U);
+	}
+
+	uint32_t parent_index = (parent == -1U ? -1U : index_of(parent));
+	uint32_t at = (parent == -1U ? size() : parent_index + subtree_sizes[parent_index]);
+	for (uint32_t a = parent_index; a != -1U; a = parents[a]) {
+		subtree_sizes[a] += 1;
+	}
+
+	if (at == size()) {
+		//fast path, append:
+		positions.emplace_back(0.0f, 0.0f, 0.0f);
+		rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+		scales.emplace_back(1.0f, 1.0f, 1.0f);
+		parents.emplace_back(parent_index);
+		subtree_sizes.emplace_back(1);
+		handles.emplace_back(handle);
+		local_to_worlds.emplace_back();
+		indices[handle] = at;
+		return handle;
+	}
+
+	//slow path, insert at the end of parent's subtree and shift everything after it:
+	std::vector< Handle > parent_handles;
+	parent_handles.reserve(size() - at + 1);
+	parent_handles.emplace_back(parent);
+	for (uint32_t i = at; i < size(); ++i) {
+		parent_handles.emplace_back(parents[i] == -1U ? -1U : handles[parents[i]]);
+	}
+	positions.insert(positions.begin() + at, glm::vec3(0.0f, 0.0f, 0.0f));
+	rotations.insert(rotations.begin() + at, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	scales.insert(scales.begin() + at, glm::vec3(1.0f, 1.0f, 1.0f));
+	parents.insert(parents.begin() + at, -1U);
+	subtree_sizes.insert(subtree_sizes.begin() + at, 1);
+	handles.insert(handles.begin() + at, handle);
+	local_to_worlds.insert(local_to_worlds.begin() + at, Affine());
+	reindex(at, parent_handles);
+	return handle;
+}
+
+void TransformStore::remove(Handle handle) {
+	uint32_t index = index_of(handle);
+
+	//children become roots (moving them to the end doesn't change 'index'):
+	while (subtree_sizes[index] > 1) {
+		set_parent(handles[index + 1], -1U);
+	}
+	assert(index_of(handle) == index);
+
+	for (uint32_t a = parents[index]; a != -1U; a = parents[a]) {
+		subtree_sizes[a] -= 1;
+	}
+
+	std::vector< Handle > parent_handles;
+	parent_handles.reserve(size() - index - 1);
+	for (uint32_t i = index + 1; i < size(); ++i) {
+		parent_handles.emplace_back(parents[i] == -1U ? -1U : handles[parents[i]]);
+	}
+	erase_at(positions, index);
+	erase_at(rotations, index);
+	erase_at(scales, index);
+	erase_at(parents, index);
+	erase_at(subtree_sizes, index);
+	erase_at(handles, index);
+	erase_at(local_to_worlds, index);
+	reindex(index, parent_handles);
+
+	indices[handle] = -1U;
+	free_handles.emplace_back(handle);
+}
+
+void TransformStore::set_parent(Handle handle, Handle parent) {
+	uint32_t index = index_of(handle);
+	uint32_t count = subtree_sizes[index];
+
+	//figure out where the subtree should go (in indices from before the move):
+	uint32_t to;
+	uint32_t parent_index = -1U;
+	if (parent == -1U) {
+		to = size();
+	} else {
+		parent_index = index_of(parent);
+		if (parent_index >= index && parent_index < index + count) {
+			throw std::runtime_error("TransformStore::set_parent would create a cycle");
+		}
+		to = parent_index + subtree_sizes[parent_index];
+	}
+
+	//fix subtree sizes (ancestors shared between old and new parent net out to zero):
+	for (uint32_t a = parents[index]; a != -1U; a = parents[a]) {
+		subtree_sizes[a] -= count;
+	}
+	for (uint32_t a = parent_index; a != -1U; a = parents[a]) {
+		subtree_sizes[a] += count;
+	}
+
+	//everything from 'begin' onward may change index:
+	uint32_t begin = std::min(index, to);
+	std::vector< Handle > parent_handles;
+	parent_handles.reserve(size() - begin);
+	for (uint32_t i = begin; i < size(); ++i) {
+		parent_handles.emplace_back(parents[i] == -1U ? -1U : handles[parents[i]]);
+	}
+	parent_handles[index - begin] = parent;
+
+	move_block(index, count, to);
+	rotate_block(parent_handles, index, count, to, begin);
+	reindex(begin, parent_handles);
+}
+
+void TransformStore::move_block(uint32_t begin, uint32_t count, uint32_t to) {
+	rotate_block(positions, begin, count, to);
+	rotate_block(rotations, begin, count, to);
+	rotate_block(scales, begin, count, to);
+	rotate_block(subtree_sizes, begin, count, to);
+	rotate_block(handles, begin, count, to);
+	rotate_block(local_to_worlds, begin, count, to);
+	//NOTE: 'parents' is rebuilt by reindex()
+}
+
+void TransformStore::reindex(uint32_t begin, std::vector< Handle > const &parent_handles) {
+	assert(parent_handles.size() == size() - begin);
+	for (uint32_t i = begin; i < size(); ++i) {
+		indices[handles[i]] = i;
+	}
+	for (uint32_t i = begin; i < size(); ++i) {
+		Handle parent = parent_handles[i - begin];
+		parents[i] = (parent == -1U ? -1U : indices[parent]);
+	}
+}
+
+void TransformStore::update() {
+	uint32_t count = size();
+	locals.resize(count);
+	make_affines(count, positions.data(), rotations.data(), scales.data(), locals.data());
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] == -1U) {
+			local_to_worlds[i] = locals[i];
+		} else {
+			local_to_worlds[i] = multiply(local_to_worlds[parents[i]], locals[i]);
+		}
+	}
+}
+
+void TransformStore::DEBUG_assert_valid() const {
+	assert(positions.size() == size());
+	assert(rotations.size() == size());
+	assert(scales.size() == size());
+	assert(parents.size() == size());
+	assert(subtree_sizes.size() == size());
+	assert(local_to_worlds.size() == size());
+	for (uint32_t i = 0; i < size(); ++i) {
+		assert(indices[handles[i]] == i);
+		assert(subtree_sizes[i] >= 1 && i + subtree_sizes[i] <= size());
+		if (parents[i] != -1U) {
+			//parent comes first and its block contains this block:
+			assert(parents[i] < i);
+			assert(i + subtree_sizes[i] <= parents[i] + subtree_sizes[parents[i]]);
+		}
+		//direct children exactly tile the rest of the block:
+		uint32_t child = i + 1;
+		while (child < i + subtree_sizes[i]) {
+			assert(parents[child] == i);
+			child += subtree_sizes[child];
+		}
+		assert(child == i + subtree_sizes[i]);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Affine.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstdint>
+
+//TransformStore is a compact alternative to a hierarchy of Scene::Transform's:
+// transforms live in parallel arrays, kept in depth-first order, so every parent
+// comes before its children and every subtree is one contiguous block.
+// This makes update() a single forward pass over sequential memory.
+//
+// Transforms are referred to by handles, which stay valid while the arrays
+// get reordered by set_parent().
+
+struct TransformStore {
+	typedef uint32_t Handle;
+
+	//add a new transform as the last child of 'parent' (or as a root if parent is -1U):
+	// note: appending to the last root (or any transform at the end of the arrays) is O(1),
+	//  otherwise later entries have to be shifted.
+	Handle add(Handle parent = -1U);
+
+	//remove a transform; its children become roots:
+	void remove(Handle handle);
+
+	//move a transform (and its subtree) to be the last child of 'parent' (-1U for a root):
+	// note: will throw if that would create a cycle.
+	void set_parent(Handle handle, Handle parent);
+	Handle get_parent(Handle handle) const;
+
+	//simple specification (by handle):
+	glm::vec3 &position(Handle handle) { return positions[index_of(handle)]; }
+	glm::quat &rotation(Handle handle) { return rotations[index_of(handle)]; }
+	glm::vec3 &scale(Handle handle) { return scales[index_of(handle)]; }
+
+	//recompute local_to_world for every transform, parents first:
+	void update();
+
+	glm::mat4 local_to_world(Handle handle) const { return to_mat4(local_to_worlds[index_of(handle)]); }
+
+	uint32_t size() const { return uint32_t(handles.size()); }
+
+	//helper that checks ordering and index consistency (slow):
+	void DEBUG_assert_valid() const;
+
+	//internals (all indexed by position in depth-first order):
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+	std::vector< uint32_t > parents; //index of parent, or -1U for roots; always less than own index
+	std::vector< uint32_t > subtree_sizes; //number of entries in subtree (including self)
+	std::vector< Handle > handles; //handle stored at each index
+	std::vector< Affine > local_to_worlds;
+	std::vector< Affine > locals; //scratch space for update()
+
+	//handle -> index lookup (-1U for free handles):
+	std::vector< uint32_t > indices;
+	std::vector< Handle > free_handles;
+
+	uint32_t index_of(Handle handle) const;
+	//move the block [begin, begin+count) so that it starts at 'to' (indices before the move):
+	void move_block(uint32_t begin, uint32_t count, uint32_t to);
+	//rebuild 'parents' and 'indices' for entries at 'begin' and after:
+	void reindex(uint32_t begin, std::vector< Handle > const &parent_handles);
+};
@@ -0,0 +1,159 @@
+#include "VertexCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//scoring constants from Forsyth's article:
+static const uint32_t CacheSize = 32; //(modelled LRU cache; bigger than real caches on purpose)
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+static float vertex_score(int32_t cache_position, uint32_t remaining) {
+	if (remaining == 0) return -1.0f; //(no triangles left to draw, so never worth picking)
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			//just used by the last triangle -- using it again right away doesn't help much:
+			score = LastTriangleScore;
+		} else {
+			score = std::pow(1.0f - float(cache_position - 3) / float(CacheSize - 3), CacheDecayPower);
+		}
+	}
+	//favor vertices with few triangles left, so they don't get stranded:
+	score += ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+	return score;
+}
+
+void optimize_vertex_cache(std::vector< uint32_t > *indices_, uint32_t vertex_count) {
+	assert(indices_);
+	std::vector< uint32_t > &indices = *indices_;
+	assert(indices.size() % 3 == 0);
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0) return;
+
+	//triangles using each vertex:
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (auto i : indices) {
+		assert(i < vertex_count);
+		++adjacency_begin[i + 1];
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		adjacency_begin[v + 1] += adjacency_begin[v];
+	}
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				adjacency[fill[indices[3 * t + c]]++] = t;
+			}
+		}
+	}
+
+	std::vector< uint32_t > remaining(vertex_count); //triangles not yet drawn, per vertex
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	std::vector< float > score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		remaining[v] = adjacency_begin[v + 1] - adjacency_begin[v];
+		score[v] = vertex_score(-1, remaining[v]);
+	}
+	std::vector< bool > drawn(triangle_count, false);
+
+	std::vector< uint32_t > cache; //most recent first
+	std::vector< uint32_t > old_cache;
+	cache.reserve(CacheSize + 3);
+	old_cache.reserve(CacheSize + 3);
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+
+	uint32_t best = -1U;
+	uint32_t scan = 0; //triangles before this are all drawn (for the fallback)
+	while (out.size() < indices.size()) {
+		if (best == -1U) {
+			//nothing in the cache has triangles left, so take the next undrawn triangle in input order:
+			// (as Forsyth does -- the cursor only moves forward, so finding these costs O(triangles) in all,
+			//  even for meshes of many disconnected pieces)
+			while (drawn[scan]) ++scan;
+			best = scan;
+		}
+
+		//draw it:
+		drawn[best] = true;
+		uint32_t const *tri = &indices[3 * best];
+		out.insert(out.end(), tri, tri + 3);
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = tri[c];
+			--remaining[v];
+			//remove from the vertex's list of triangles still to draw:
+			uint32_t *begin = &adjacency[adjacency_begin[v]];
+			uint32_t *end = begin + remaining[v] + 1;
+			*std::find(begin, end, best) = *(end - 1);
+		}
+
+		//move its vertices to the front of the cache:
+		old_cache.swap(cache);
+		cache.assign(tri, tri + 3);
+		for (auto v : old_cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) cache.emplace_back(v);
+		}
+
+		//rescore everything that was or is in the cache -- including the vertices just pushed out of it --
+		// and pick the best of the triangles around them:
+		for (uint32_t p = 0; p < cache.size(); ++p) {
+			cache_position[cache[p]] = (p < CacheSize ? int32_t(p) : -1);
+		}
+		for (auto v : cache) {
+			score[v] = vertex_score(cache_position[v], remaining[v]);
+		}
+
+		best = -1U;
+		float best_score = -1.0f;
+		for (auto v : cache) {
+			for (uint32_t a = adjacency_begin[v]; a < adjacency_begin[v] + remaining[v]; ++a) {
+				uint32_t t = adjacency[a];
+				float s = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+				if (s > best_score) {
+					best = t;
+					best_score = s;
+				}
+			}
+		}
+		if (cache.size() > CacheSize) cache.resize(CacheSize);
+	}
+
+	indices.swap(out);
+}
+
+void order_vertices_by_use(std::vector< uint32_t > *indices_, uint32_t vertex_count, std::vector< uint32_t > *order_) {
+	assert(indices_);
+	assert(order_);
+	std::vector< uint32_t > &indices = *indices_;
+	std::vector< uint32_t > &order = *order_;
+
+	std::vector< uint32_t > renumber(vertex_count, -1U);
+	order.clear();
+	for (auto &i : indices) {
+		if (renumber[i] == -1U) {
+			renumber[i] = uint32_t(order.size());
+			order.emplace_back(i);
+		}
+		i = renumber[i];
+	}
+}
+
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint32_t > stamp(vertex_count, 0); //when each vertex entered the cache (0 = never)
+	uint32_t misses = 0;
+	for (auto i : indices) {
+		//FIFO: a vertex stays in until 'cache_size' misses after it was loaded:
+		if (stamp[i] == 0 || misses - stamp[i] >= cache_size) {
+			++misses;
+			stamp[i] = misses;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
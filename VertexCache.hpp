@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Helpers for indexed triangle lists and the GPU's post-transform vertex cache.
+
+//reorder triangles (three indices each) so that vertices are reused while they are still in
+// the cache, using Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+// indices must be less than vertex_count.
+void optimize_vertex_cache(std::vector< uint32_t > *indices, uint32_t vertex_count);
+
+//renumber vertices in the order the (optimized) indices first use them, so vertex fetches
+// also walk through memory in order: fills 'order' with the old index of each new vertex.
+void order_vertices_by_use(std::vector< uint32_t > *indices, uint32_t vertex_count, std::vector< uint32_t > *order);
+
+//average cache miss ratio -- vertex shader invocations per triangle, for a FIFO cache of
+// 'cache_size' entries (3.0 for unshared vertices; around 0.6-0.7 is ideal for smooth meshes):
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size = 16);
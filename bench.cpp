@@ -0,0 +1,434 @@
+#include "Scene.hpp"
+#include "TransformStore.hpp"
+#include "Affine.hpp"
+#include "BVH.hpp"
+
+#include <SDL.h> //(for SDL_main on windows)
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//bench: timing for scene update code paths, on synthetic data.
+// usage: bench [transform count ...]
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static float ms_since(Clock::time_point const &before) {
+	return std::chrono::duration< float, std::milli >(Clock::now() - before).count();
+}
+
+//random hierarchy: parents[i] < i, or -1U for roots.
+// returned in depth-first order, so that it can be appended to a TransformStore directly.
+static std::vector< uint32_t > make_hierarchy(uint32_t count, std::mt19937 &mt) {
+	std::vector< uint32_t > parents(count, -1U);
+	for (uint32_t i = 1; i < count; ++i) {
+		if (mt() % 64 != 0) parents[i] = mt() % i;
+	}
+
+	//reorder depth-first:
+	std::vector< std::vector< uint32_t > > children(count);
+	std::vector< uint32_t > roots;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] == -1U) roots.emplace_back(i);
+		else children[parents[i]].emplace_back(i);
+	}
+	std::vector< uint32_t > order;
+	order.reserve(count);
+	std::vector< uint32_t > stack(roots.rbegin(), roots.rend());
+	while (!stack.empty()) {
+		uint32_t i = stack.back();
+		stack.pop_back();
+		order.emplace_back(i);
+		stack.insert(stack.end(), children[i].rbegin(), children[i].rend());
+	}
+	std::vector< uint32_t > new_index(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		new_index[order[i]] = i;
+	}
+	std::vector< uint32_t > ret(count, -1U);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[order[i]] != -1U) ret[i] = new_index[parents[order[i]]];
+	}
+	return ret;
+}
+
+//the pre-caching way of computing a world matrix, for reference:
+static glm::mat4 uncached_local_to_world(Scene::Transform const &transform) {
+	if (transform.parent) {
+		return uncached_local_to_world(*transform.parent) * transform.make_local_to_parent();
+	} else {
+		return transform.make_local_to_parent();
+	}
+}
+
+//TRS -> matrix composition, the way Transform::make_local_to_parent() used to do it:
+static glm::mat4 glm_compose(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	glm::mat4 translate(1.0f);
+	translate[3] = glm::vec4(position, 1.0f);
+	glm::mat4 scaling(1.0f);
+	scaling[0][0] = scale.x;
+	scaling[1][1] = scale.y;
+	scaling[2][2] = scale.z;
+	return translate * glm::mat4_cast(rotation) * scaling;
+}
+
+static void bench_compose(uint32_t count) {
+	const uint32_t Frames = 5;
+	std::mt19937 mt(0x87654321);
+	std::vector< glm::vec3 > positions(count);
+	std::vector< glm::quat > rotations(count);
+	std::vector< glm::vec3 > scales(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		positions[i] = glm::vec3((mt() % 200) * 0.01f, (mt() % 200) * 0.01f, (mt() % 200) * 0.01f);
+		rotations[i] = glm::angleAxis((mt() % 628) * 0.01f, glm::normalize(glm::vec3(1.0f, (mt() % 10) * 0.1f, 0.5f)));
+		scales[i] = glm::vec3(1.0f + (mt() % 10) * 0.01f);
+	}
+	std::vector< glm::mat4 > mat4s(count);
+	std::vector< Affine > affines(count);
+
+	float ms[3] = {0.0f, 0.0f, 0.0f};
+	float checksum[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			mat4s[i] = glm_compose(positions[i], rotations[i], scales[i]);
+		}
+		ms[0] += ms_since(before);
+		checksum[0] += mat4s[count / 2][0].y;
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			affines[i] = make_affine(positions[i], rotations[i], scales[i]);
+		}
+		ms[1] += ms_since(before);
+		checksum[1] += affines[count / 2].rows[1][0];
+
+		before = Clock::now();
+		make_affines(count, positions.data(), rotations.data(), scales.data(), affines.data());
+		ms[2] += ms_since(before);
+		checksum[2] += affines[count / 2].rows[1][0];
+	}
+
+	std::cout << "TRS compose: " << count << " records\n";
+	char const *names[3] = {"glm T*R*S", "make_affine", "make_affines (batch)"};
+	for (uint32_t i = 0; i < 3; ++i) {
+		std::cout << "  " << names[i] << ": " << ms[i] / Frames << " ms/frame"
+		          << " (" << ms[0] / ms[i] << "x, checksum " << checksum[i] << ")\n";
+	}
+	std::cout.flush();
+}
+
+//inverse and normal matrices: the general path vs. the uniform-scale ("similarity") shortcut:
+static void bench_inverses(uint32_t count) {
+	const uint32_t Frames = 5;
+	std::mt19937 mt(0x24681357);
+	std::vector< glm::vec3 > positions(count);
+	std::vector< glm::quat > rotations(count);
+	std::vector< glm::vec3 > scales(count);
+	std::vector< Affine > parent_to_world(count), parent_from_world(count), local_to_world(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		positions[i] = glm::vec3((mt() % 200) * 0.01f, (mt() % 200) * 0.01f, (mt() % 200) * 0.01f);
+		rotations[i] = glm::angleAxis((mt() % 628) * 0.01f, glm::normalize(glm::vec3(1.0f, (mt() % 10) * 0.1f, 0.5f)));
+		scales[i] = glm::vec3(1.0f + (mt() % 10) * 0.1f);
+		glm::vec3 parent_position = glm::vec3((mt() % 200) * 0.01f, 0.0f, 0.0f);
+		glm::quat parent_rotation = glm::angleAxis((mt() % 628) * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::vec3 parent_scale = glm::vec3(0.5f + (mt() % 10) * 0.1f);
+		parent_to_world[i] = make_affine(parent_position, parent_rotation, parent_scale);
+		parent_from_world[i] = make_inverse_affine(parent_position, parent_rotation, parent_scale);
+		local_to_world[i] = multiply(parent_to_world[i], make_affine(positions[i], rotations[i], scales[i]));
+	}
+	std::vector< Affine > inverses(count);
+	std::vector< glm::mat3 > normals(count), reference(count);
+
+	//(max abs difference from the first method, so the shortcuts can be checked)
+	float ms[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	float error[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	std::vector< Affine > reference_inverses(count);
+	auto inverse_error = [&](uint32_t method) {
+		for (uint32_t i = 0; i < count; ++i) {
+			for (int r = 0; r < 3; ++r) {
+				for (int c = 0; c < 4; ++c) {
+					error[method] = std::max(error[method], std::abs(inverses[i].rows[r][c] - reference_inverses[i].rows[r][c]));
+				}
+			}
+		}
+	};
+	auto normal_error = [&](uint32_t method) {
+		for (uint32_t i = 0; i < count; ++i) {
+			for (int c = 0; c < 3; ++c) {
+				for (int r = 0; r < 3; ++r) {
+					error[method] = std::max(error[method], std::abs(normals[i][c][r] - reference[i][c][r]));
+				}
+			}
+		}
+	};
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		//world_to_local, the way Transform used to: local inverse times (cached) parent inverse:
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			reference_inverses[i] = multiply(make_inverse_affine(positions[i], rotations[i], scales[i]), parent_from_world[i]);
+		}
+		ms[0] += ms_since(before);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			inverses[i] = invert(local_to_world[i]);
+		}
+		ms[1] += ms_since(before);
+		inverse_error(1);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			inverses[i] = invert_similarity(local_to_world[i]);
+		}
+		ms[2] += ms_since(before);
+		inverse_error(2);
+
+		//normal matrix, the way Scene::prepare() used to:
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			reference[i] = glm::inverse(glm::transpose(to_mat3(local_to_world[i])));
+		}
+		ms[3] += ms_since(before);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			normals[i] = normal_matrix(local_to_world[i]);
+		}
+		ms[4] += ms_since(before);
+		normal_error(4);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			normals[i] = normal_matrix_similarity(local_to_world[i]);
+		}
+		ms[5] += ms_since(before);
+		normal_error(5);
+	}
+
+	std::cout << "Inverses: " << count << " records (uniform scale)\n";
+	char const *names[6] = {"world_to_local, composed", "invert", "invert_similarity", "itmv, glm::inverse", "normal_matrix", "normal_matrix_similarity"};
+	for (uint32_t i = 0; i < 6; ++i) {
+		uint32_t baseline = (i < 3 ? 0 : 3);
+		std::cout << "  " << names[i] << ": " << ms[i] / Frames << " ms/frame"
+		          << " (" << ms[baseline] / ms[i] << "x, max error " << error[i] << ")\n";
+	}
+	std::cout.flush();
+}
+
+static void bench_transforms(uint32_t count) {
+	const uint32_t Frames = 5;
+	std::mt19937 mt(0x12345678);
+	std::vector< uint32_t > parents = make_hierarchy(count, mt);
+
+	uint32_t max_depth = 0;
+	{
+		std::vector< uint32_t > depths(count, 0);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (parents[i] != -1U) depths[i] = depths[parents[i]] + 1;
+			max_depth = std::max(max_depth, depths[i]);
+		}
+	}
+
+	std::vector< glm::vec3 > positions(count);
+	std::vector< glm::vec3 > scales(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		positions[i] = glm::vec3((mt() % 200) * 0.01f - 1.0f, (mt() % 200) * 0.01f - 1.0f, (mt() % 200) * 0.01f - 1.0f);
+		scales[i] = glm::vec3(1.0f + (mt() % 10) * 0.01f);
+	}
+	auto rotation_at = [](uint32_t i, uint32_t frame) {
+		return glm::angleAxis(0.001f * float(i % 1000) + 0.1f * float(frame), glm::vec3(0.0f, 0.0f, 1.0f));
+	};
+
+	//pointer-based hierarchy:
+	std::unique_ptr< Scene::Transform[] > transforms(new Scene::Transform[count]);
+	for (uint32_t i = 0; i < count; ++i) {
+		transforms[i].set_position(positions[i]);
+		transforms[i].set_scale(scales[i]);
+		if (parents[i] != -1U) transforms[i].set_parent(&transforms[parents[i]]);
+	}
+
+	//flattened:
+	TransformStore store;
+	std::vector< TransformStore::Handle > handles(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		handles[i] = store.add(parents[i] == -1U ? -1U : handles[parents[i]]);
+		store.position(handles[i]) = positions[i];
+		store.scale(handles[i]) = scales[i];
+	}
+
+	float checksum[3] = {0.0f, 0.0f, 0.0f};
+	float ms[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		//every transform moves every frame (worst case for the cache):
+		for (uint32_t i = 0; i < count; ++i) {
+			transforms[i].set_rotation(rotation_at(i, frame));
+			store.rotation(handles[i]) = rotation_at(i, frame);
+		}
+
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			checksum[0] += uncached_local_to_world(transforms[i])[3].x;
+		}
+		ms[0] += ms_since(before);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			checksum[1] += transforms[i].make_local_to_world()[3].x;
+		}
+		ms[1] += ms_since(before);
+
+		before = Clock::now();
+		store.update();
+		for (uint32_t i = 0; i < count; ++i) {
+			checksum[2] += store.local_to_worlds[i].rows[0][3];
+		}
+		ms[2] += ms_since(before);
+	}
+
+	std::cout << "transforms: " << count << " (max depth " << max_depth << ")\n";
+	char const *names[3] = {"pointer, uncached", "pointer, cached", "TransformStore"};
+	for (uint32_t i = 0; i < 3; ++i) {
+		std::cout << "  " << names[i] << ": " << ms[i] / Frames << " ms/frame"
+		          << " (" << ms[0] / ms[i] << "x, checksum " << checksum[i] << ")\n";
+	}
+	std::cout.flush();
+}
+
+//Scene::prepare() on a synthetic scene, with 1 ... N threads:
+static void bench_prepare(uint32_t count) {
+	const uint32_t Frames = 5;
+	std::mt19937 mt(0x13572468);
+	std::vector< uint32_t > parents = make_hierarchy(count, mt);
+
+	Scene scene;
+	scene.camera.transform.set_position(glm::vec3(0.0f, 0.0f, 20.0f));
+	std::vector< Scene::ObjectHandle > objects;
+	objects.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		objects.emplace_back(scene.objects.emplace());
+		Scene::Object &object = scene.objects[objects.back()];
+		object.transform.set_position(glm::vec3((mt() % 200) * 0.01f - 1.0f, (mt() % 200) * 0.01f - 1.0f, (mt() % 200) * 0.01f - 1.0f));
+		if (parents[i] != -1U) object.transform.set_parent(&scene.objects[objects[parents[i]]].transform);
+		object.sphere_radius = 0.1f;
+	}
+	//a sun and a few hundred small point lights, so per-object light lists get built:
+	const uint32_t PointLights = 256;
+	scene.lights.emplace_back();
+	for (uint32_t i = 0; i < PointLights; ++i) {
+		scene.lights.emplace_back();
+		Scene::Light &light = scene.lights.back();
+		light.type = Scene::Light::Point;
+		light.transform.set_position(glm::vec3((mt() % 400) * 0.01f - 2.0f, (mt() % 400) * 0.01f - 2.0f, (mt() % 400) * 0.01f - 2.0f));
+		light.range = 0.5f;
+	}
+
+	std::cout << "Scene::prepare: " << count << " objects, " << scene.lights.size() << " lights\n";
+	float single_ms = 0.0f;
+	uint32_t max_threads = ThreadPool::default_workers() + 1;
+	for (uint32_t threads = 1; threads <= max_threads; ++threads) {
+		ThreadPool pool(threads - 1);
+		scene.pool = &pool;
+		float ms = 0.0f;
+		for (uint32_t frame = 0; frame < Frames; ++frame) {
+			//everything moves:
+			for (uint32_t i = 0; i < count; ++i) {
+				scene.objects[objects[i]].transform.set_rotation(glm::angleAxis(0.01f * float(frame + i % 100), glm::vec3(0.0f, 0.0f, 1.0f)));
+			}
+			auto before = Clock::now();
+			scene.prepare();
+			ms += ms_since(before);
+		}
+		scene.pool = nullptr;
+		ms /= Frames;
+		if (threads == 1) single_ms = ms;
+		std::cout << "  " << threads << " thread(s): " << ms << " ms/frame (" << single_ms / ms << "x)"
+		          << " [tested " << scene.stats.tested << ", culled " << scene.stats.culled << ", drawn " << scene.stats.drawn << ", moved " << scene.stats.moved << ", rebuilt " << scene.stats.rebuilt << "]\n";
+	}
+	std::cout.flush();
+}
+
+//BVH sphere queries against a linear scan over all boxes:
+static void bench_queries(uint32_t count) {
+	const uint32_t Queries = 1000;
+	std::mt19937 mt(0x24681357);
+	//objects spread over a cube that grows with the count (so density stays the same):
+	float size = std::cbrt(float(count)) * 2.0f;
+	auto random_coord = [&]() { return (mt() % 10000) * 0.0001f * size; };
+
+	BVH bvh;
+	std::vector< uint32_t > leaves(count);
+	auto before = Clock::now();
+	for (uint32_t i = 0; i < count; ++i) {
+		BVH::Box box;
+		box.min = glm::vec3(random_coord(), random_coord(), random_coord());
+		box.max = box.min + glm::vec3(0.5f);
+		leaves[i] = bvh.insert(box, i);
+	}
+	float insert_ms = ms_since(before);
+	float insert_cost = bvh.cost();
+	before = Clock::now();
+	bvh.build();
+	float build_ms = ms_since(before);
+
+	std::vector< glm::vec3 > centers(Queries);
+	for (auto &center : centers) {
+		center = glm::vec3(random_coord(), random_coord(), random_coord());
+	}
+	const float Radius = 2.0f;
+
+	uint32_t hits[2] = {0, 0};
+	before = Clock::now();
+	for (auto const &center : centers) {
+		for (auto leaf : leaves) {
+			BVH::Box const &box = bvh.box(leaf);
+			glm::vec3 d = glm::max(box.min - center, glm::max(glm::vec3(0.0f), center - box.max));
+			if (glm::dot(d, d) <= Radius * Radius) ++hits[0];
+		}
+	}
+	float linear_ms = ms_since(before) / Queries;
+
+	std::vector< uint32_t > found;
+	before = Clock::now();
+	for (auto const &center : centers) {
+		found.clear();
+		bvh.query(center, Radius, &found);
+		hits[1] += uint32_t(found.size());
+	}
+	float bvh_ms = ms_since(before) / Queries;
+
+	std::cout << "BVH: " << count << " boxes\n";
+	std::cout << "  insert: " << insert_ms << " ms (cost " << insert_cost << "), SAH build: " << build_ms << " ms (cost " << bvh.cost() << ")\n";
+	std::cout << "  sphere query, linear: " << linear_ms << " ms (" << hits[0] << " hits)\n";
+	std::cout << "  sphere query, BVH: " << bvh_ms << " ms (" << linear_ms / bvh_ms << "x, " << hits[1] << " hits)\n";
+	std::cout.flush();
+}
+
+int main(int argc, char **argv) {
+	std::vector< uint32_t > counts;
+	for (int i = 1; i < argc; ++i) {
+		counts.emplace_back(std::stoul(argv[i]));
+	}
+	if (counts.empty()) {
+		counts = {10000, 100000, 1000000};
+	}
+
+	for (auto count : counts) {
+		bench_compose(count);
+		bench_inverses(count);
+		bench_transforms(count);
+		bench_prepare(count);
+		bench_queries(count);
+	}
+
+	return 0;
+}
@@ -0,0 +1,286 @@
+#include "GL.hpp"
+#include "Meshes.hpp"
+#include "Headless.hpp"
+#include "Blob.hpp"
+#include "write_chunk.hpp"
+
+#include <SDL.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+//load_bench: times Meshes::load on one mesh file, reading it through a memory mapping or an istream.
+// usage: load_bench [--stream] [--float-vertices] [--no-lods] [--repeat N] [--budget BYTES] [file.blob]
+//        load_bench --make file.blob MB [--grid N] [--legacy] (writes a synthetic v3n3 file of about MB megabytes of N-by-N grids to load)
+// With --budget, loads go through load_async() and update(BYTES) is called once per (simulated, 60Hz) frame.
+// After the first load, every mesh is looked up with find() by name and by MeshID, to time the lookups.
+// Peak RSS only ever goes up, so compare --stream and mapped loads in separate runs.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+//peak resident set size of the process so far, in bytes (0 where unavailable):
+static size_t peak_rss() {
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return size_t(usage.ru_maxrss); //(bytes on macOS)
+#else
+	return size_t(usage.ru_maxrss) * 1024; //(kilobytes on Linux)
+#endif
+#endif
+}
+
+//write a file of smooth-shaded grids (so welding has something to do) with about 'megabytes' of vertex data:
+//(small grids make many meshes, e.g. to time lookups; 'legacy' writes the older, unversioned chunk layout)
+static void make_blob(std::string const &filename, uint32_t megabytes, uint32_t Size, bool legacy) {
+	std::vector< Meshes::Vertex > data;
+	std::vector< char > strings;
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_start, vertex_count;
+	};
+	std::vector< IndexEntry > index;
+	for (uint32_t mesh = 0; data.size() * sizeof(Meshes::Vertex) < size_t(megabytes) * 1024 * 1024; ++mesh) {
+		IndexEntry entry;
+		std::string name = "grid" + std::to_string(mesh);
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.vertex_start = uint32_t(data.size());
+
+		glm::vec3 color = glm::vec3((mesh % 7) / 6.0f, (mesh % 5) / 4.0f, (mesh % 3) / 2.0f);
+		auto vertex = [&](uint32_t x, uint32_t y) {
+			Meshes::Vertex v;
+			float h = 0.1f * float((x * 7 + y * 13 + mesh) % 5);
+			v.position = glm::vec3(float(x), float(y), h);
+			v.normal = glm::normalize(glm::vec3(0.1f * h, -0.1f * h, 1.0f));
+			v.color = color;
+			data.emplace_back(v);
+		};
+		for (uint32_t y = 0; y < Size; ++y) {
+			for (uint32_t x = 0; x < Size; ++x) {
+				vertex(x, y); vertex(x + 1, y); vertex(x + 1, y + 1);
+				vertex(x, y); vertex(x + 1, y + 1); vertex(x, y + 1);
+			}
+		}
+		entry.vertex_count = uint32_t(data.size()) - entry.vertex_start;
+		index.emplace_back(entry);
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	if (legacy) {
+		write_chunk("v3n3", data, &out);
+		write_chunk("str0", strings, &out);
+		write_chunk("idx0", index, &out);
+	} else {
+		BlobWriter blob;
+		blob.add("v3n3", data, 64);
+		blob.add("str0", strings);
+		blob.add("idx0", index);
+		blob.write(&out);
+	}
+	if (!out) throw std::runtime_error("Failed to write '" + filename + "'.");
+	std::cout << "Wrote " << index.size() << " meshes (" << data.size() << " vertices) to '" << filename << "'." << std::endl;
+}
+
+int main(int argc, char **argv) {
+	//Configuration:
+	struct {
+		std::string filename = "meshes.blob";
+		bool map_files = true;
+		bool quantize = true;
+		bool lods = true;
+		uint32_t repeat = 1;
+		size_t budget = 0; //if nonzero, load in the background and upload this much per update()
+		std::string make; //if set, write a synthetic file here (instead of loading one)
+		uint32_t make_megabytes = 0;
+		uint32_t make_grid = 64; //grid cells on a side
+		bool make_legacy = false;
+	} config;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--stream") {
+			config.map_files = false;
+		} else if (arg == "--float-vertices") {
+			config.quantize = false;
+		} else if (arg == "--no-lods") {
+			config.lods = false;
+		} else if (arg == "--repeat" && argi + 1 < argc) {
+			config.repeat = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--budget" && argi + 1 < argc) {
+			config.budget = size_t(std::stoull(argv[++argi]));
+		} else if (arg == "--make" && argi + 2 < argc) {
+			config.make = argv[++argi];
+			config.make_megabytes = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--grid" && argi + 1 < argc) {
+			config.make_grid = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--legacy") {
+			config.make_legacy = true;
+		} else if (arg.substr(0, 2) != "--") {
+			config.filename = arg;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--stream] [--float-vertices] [--no-lods] [--repeat N] [--budget BYTES] [file.blob]\n"
+			          << "\t" << argv[0] << " --make file.blob MB [--grid N] [--legacy]\n"
+			          << "--stream reads the file with an istream instead of mapping it.\n"
+			          << "--float-vertices uploads 36-byte float vertices instead of 16-byte quantized ones.\n"
+			          << "--no-lods skips building levels of detail.\n"
+			          << "--repeat loads the file N times (peak RSS is as of the first load).\n"
+			          << "--budget loads in the background, uploading at most BYTES per update() call.\n"
+			          << "--make writes a synthetic mesh file with about MB megabytes of vertices, in meshes of N-by-N cells (default 64);\n"
+			          << "  with --legacy, in the older unversioned format (no table of contents or checksums)." << std::endl;
+			return 1;
+		}
+	}
+
+	if (!config.make.empty()) {
+		make_blob(config.make, config.make_megabytes, config.make_grid, config.make_legacy);
+		return 0;
+	}
+
+	//------------  initialization ------------
+
+	//(same context setup as scene_bench)
+	Headless headless;
+	SDL_Window *window = nullptr;
+	SDL_GLContext context = nullptr;
+	{
+		std::string error;
+		if (!headless.create(&error)) {
+			std::cerr << "NOTE: no headless OpenGL context (" << error << "); using a hidden window." << std::endl;
+			SDL_Init(SDL_INIT_VIDEO);
+			SDL_GL_ResetAttributes();
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+			window = SDL_CreateWindow("load_bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+			if (!window) {
+				std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+				return 1;
+			}
+			context = SDL_GL_CreateContext(window);
+			if (!context) {
+				SDL_DestroyWindow(window);
+				std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	#ifdef _WIN32
+	//On windows, load OpenGL extensions:
+	if (!init_gl_shims()) {
+		std::cerr << "ERROR: failed to initialize shims." << std::endl;
+		return 1;
+	}
+	#endif
+
+	//(the fixed locations Programs uses)
+	Meshes::Attributes attributes;
+	attributes.Position = 0;
+	attributes.Normal = 1;
+	attributes.Color = 2;
+	attributes.MeshIndex = 3;
+
+	//------------ loads ------------
+
+	size_t rss_before = peak_rss();
+	size_t rss_after = 0;
+	std::vector< double > times;
+	Meshes::Stats stats;
+	//(background loads) frames until done, and the slowest update(), which is what a frame would stall for:
+	uint32_t frames = 0;
+	double longest_update = 0.0;
+	//lookups after the first load (nanoseconds each):
+	size_t lookups = 0;
+	double by_name = 0.0, by_id = 0.0;
+	for (uint32_t r = 0; r < config.repeat; ++r) {
+		Meshes meshes; //(fresh each time, so names don't collide)
+		meshes.map_files = config.map_files;
+		meshes.quantize = config.quantize;
+		meshes.lods = config.lods;
+		auto before = Clock::now();
+		if (config.budget) {
+			meshes.load_async(config.filename, attributes);
+			while (meshes.loading()) {
+				auto update_before = Clock::now();
+				meshes.update(config.budget);
+				glFinish();
+				longest_update = std::max(longest_update, std::chrono::duration< double, std::milli >(Clock::now() - update_before).count());
+				++frames;
+				std::this_thread::sleep_until(update_before + std::chrono::microseconds(16667));
+			}
+		} else {
+			meshes.load(config.filename, attributes);
+			glFinish();
+		}
+		times.emplace_back(std::chrono::duration< double, std::milli >(Clock::now() - before).count());
+		if (r == 0) {
+			rss_after = peak_rss();
+			stats = meshes.stats;
+
+			std::vector< std::string > names = meshes.names;
+			std::vector< MeshID > ids;
+			for (auto const &name : names) ids.emplace_back(meshes.intern(name));
+			const uint32_t Rounds = 100;
+			size_t found = 0;
+			auto name_before = Clock::now();
+			for (uint32_t round = 0; round < Rounds; ++round) {
+				for (auto const &name : names) found += (meshes.find(name) != nullptr);
+			}
+			auto id_before = Clock::now();
+			for (uint32_t round = 0; round < Rounds; ++round) {
+				for (MeshID id : ids) found += (meshes.find(id) != nullptr);
+			}
+			auto id_after = Clock::now();
+			lookups = names.size() * Rounds;
+			if (found != 2 * lookups) throw std::runtime_error("Lookup failed to find a loaded mesh.");
+			if (lookups) {
+				by_name = std::chrono::duration< double, std::nano >(id_before - name_before).count() / lookups;
+				by_id = std::chrono::duration< double, std::nano >(id_after - id_before).count() / lookups;
+			}
+		}
+	}
+
+	std::sort(times.begin(), times.end());
+	double total = 0.0;
+	for (double t : times) total += t;
+	std::cout << "load_bench: '" << config.filename << "', " << stats.file_bytes << " bytes, "
+	          << (config.map_files ? "mapped" : "stream") << ", " << (config.quantize ? "quantized" : "float") << " vertices\n"
+	          << "  " << stats.unrolled_vertices << " vertices welded to " << stats.vertices << ", " << stats.vertex_bytes << " bytes uploaded\n"
+	          << "  " << stats.triangles << " triangles, plus " << stats.lod_triangles << " in levels of detail\n"
+	          << "  load: mean " << total / times.size() << " ms, min " << times[0] << " ms, max " << times.back() << " ms over " << times.size() << " loads"
+	          << " (upload " << stats.upload_seconds * 1000.0 << " ms of the first)\n";
+	if (config.budget) {
+		std::cout << "  background: done after " << frames << " frames uploading up to " << config.budget << " bytes each; the longest update() took "
+		          << longest_update << " ms\n";
+	}
+	std::cout << "  lookups: " << by_name << " ns by name, " << by_id << " ns by id (" << lookups << " find() calls each)\n";
+	if (rss_after != 0) {
+		std::cout << "  peak RSS: " << rss_before / 1024 << " KiB before, " << rss_after / 1024 << " KiB after the first load (+"
+		          << (rss_after - rss_before) / 1024 << " KiB)" << std::endl;
+	} else {
+		std::cout << "  peak RSS: not available on this platform" << std::endl;
+	}
+
+	//------------  teardown ------------
+
+	if (context) SDL_GL_DeleteContext(context);
+	if (window) SDL_DestroyWindow(window);
+
+	return 0;
+}
@@ -1,7 +1,12 @@
 #include "load_save_png.hpp"
 #include "GL.hpp"
 #include "Meshes.hpp"
+#include "Programs.hpp"
 #include "Scene.hpp"
+#include "Headless.hpp"
+#include "Profiler.hpp"
+#include "GPUTimers.hpp"
+#include "InputLog.hpp"
 #include "read_chunk.hpp"
 
 #include <SDL.h>
@@ -9,62 +14,151 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
 
-static GLuint compile_shader(GLenum type, std::string const &source);
-static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
-
 int main(int argc, char **argv) {
 	//Configuration:
 	struct {
 		std::string title = "Game2: Robot Fun Police";
 		glm::uvec2 size = glm::uvec2(640, 480);
+		bool headless = false; //render offscreen, without a window (for benchmarks)
+		uint32_t frames = 0; //quit after this many frames (0 means "run until closed")
+		std::string png; //if set, save the last of 'frames' frames here
+		std::string trace; //if set, write the last few frames' profile here on exit
+		std::string record; //if set, record input here (written on exit)
+		std::string replay; //if set, play back input recorded with 'record' instead of reading it
+		bool uncapped = false; //don't wait for vsync (to measure frame rate)
+		bool float_vertices = false; //upload full-precision vertices rather than quantized ones (to compare)
+		size_t upload_budget = 1 << 20; //bytes of mesh data to upload per frame while meshes stream in
 	} config;
 
-	//------------  initialization ------------
-
-	//Initialize SDL library:
-	SDL_Init(SDL_INIT_VIDEO);
-
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
-	SDL_GL_ResetAttributes();
-	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-
-	//create window:
-	SDL_Window *window = SDL_CreateWindow(
-		config.title.c_str(),
-		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-		config.size.x, config.size.y,
-		SDL_WINDOW_OPENGL /*| SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI*/
-	);
-
-	if (!window) {
-		std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+	//how many frames of profile to write to trace files:
+	const uint32_t TraceFrames = 120;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--headless") {
+			config.headless = true;
+		} else if (arg == "--frames" && argi + 1 < argc) {
+			config.frames = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--png" && argi + 1 < argc) {
+			config.png = argv[++argi];
+		} else if (arg == "--trace" && argi + 1 < argc) {
+			config.trace = argv[++argi];
+		} else if (arg == "--record" && argi + 1 < argc) {
+			config.record = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			config.replay = argv[++argi];
+		} else if (arg == "--uncapped") {
+			config.uncapped = true;
+		} else if (arg == "--float-vertices") {
+			config.float_vertices = true;
+		} else if (arg == "--upload-budget" && argi + 1 < argc) {
+			config.upload_budget = std::max(size_t(1), size_t(std::stoull(argv[++argi])));
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--headless] [--frames N] [--png file.png] [--trace file.json] [--record file | --replay file] [--uncapped] [--float-vertices] [--upload-budget bytes]\n"
+			          << "--headless renders offscreen, with a fixed time step, for 100 frames unless --frames says otherwise.\n"
+			          << "--png saves the last frame (so needs a frame count).\n"
+			          << "--trace writes a Chrome trace of the last " << TraceFrames << " frames on exit (P writes one to 'trace.json' at any time).\n"
+			          << "--record saves input (events, keyboard state, and frame times) on exit; --replay plays it back, then quits.\n"
+			          << "--uncapped turns off vsync.\n"
+			          << "--float-vertices uploads 36-byte float vertices instead of 16-byte quantized ones.\n"
+			          << "--upload-budget limits how much mesh data is uploaded per frame while meshes stream in (default " << config.upload_budget << ")." << std::endl;
+			return 1;
+		}
+	}
+	if (!config.record.empty() && !config.replay.empty()) {
+		std::cerr << "--record and --replay can't be used together." << std::endl;
 		return 1;
 	}
 
-	//Create OpenGL context:
-	SDL_GLContext context = SDL_GL_CreateContext(window);
+	//recorded input (when recording or replaying):
+	InputLog input_log;
+	bool recording = !config.record.empty();
+	bool replaying = !config.replay.empty();
+	if (replaying) {
+		input_log.load(config.replay);
+		//stop at the end of the recording (so the timing summary gets printed):
+		if (config.frames == 0 || config.frames > input_log.frame_count()) config.frames = input_log.frame_count();
+		if (config.frames == 0) {
+			std::cerr << "'" << config.replay << "' has no frames to replay." << std::endl;
+			return 1;
+		}
+	}
 
-	if (!context) {
-		SDL_DestroyWindow(window);
-		std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+	if (config.headless && config.frames == 0) config.frames = 100;
+	if (!config.png.empty() && config.frames == 0) {
+		std::cerr << "--png needs --frames (or --headless) so there is a last frame to save." << std::endl;
 		return 1;
 	}
 
+	//------------  initialization ------------
+
+	SDL_Window *window = nullptr;
+	SDL_GLContext context = nullptr;
+	Headless headless;
+	//(headless only) there is no window, so render into a framebuffer object instead:
+	GLuint framebuffer = 0;
+	GLuint framebuffer_color = 0;
+	GLuint framebuffer_depth = 0;
+
+	if (config.headless) {
+		//Initialize SDL library (just events -- keyboard state will stay empty):
+		SDL_Init(SDL_INIT_EVENTS);
+
+		//Create OpenGL context (also 3.3 core), with no window or display:
+		std::string error;
+		if (!headless.create(&error)) {
+			std::cerr << "Error creating headless OpenGL context: " << error << std::endl;
+			return 1;
+		}
+		//(nothing to swap, so no vsync to turn off)
+	} else {
+		//Initialize SDL library:
+		SDL_Init(SDL_INIT_VIDEO);
+
+		//Ask for an OpenGL context version 3.3, core profile, enable debug:
+		SDL_GL_ResetAttributes();
+		SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+		SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+		//create window:
+		window = SDL_CreateWindow(
+			config.title.c_str(),
+			SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+			config.size.x, config.size.y,
+			SDL_WINDOW_OPENGL /*| SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI*/
+		);
+
+		if (!window) {
+			std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+
+		//Create OpenGL context:
+		context = SDL_GL_CreateContext(window);
+
+		if (!context) {
+			SDL_DestroyWindow(window);
+			std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+	}
+
 	#ifdef _WIN32
 	//On windows, load OpenGL extensions:
 	if (!init_gl_shims()) {
@@ -73,11 +167,37 @@ int main(int argc, char **argv) {
 	}
 	#endif
 
-	//Set VSYNC + Late Swap (prevents crazy FPS):
-	if (SDL_GL_SetSwapInterval(-1) != 0) {
-		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
-		if (SDL_GL_SetSwapInterval(1) != 0) {
-			std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
+	if (config.headless) {
+		//Make a window-sized render target:
+		glGenRenderbuffers(1, &framebuffer_color);
+		glBindRenderbuffer(GL_RENDERBUFFER, framebuffer_color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, config.size.x, config.size.y);
+		glGenRenderbuffers(1, &framebuffer_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, framebuffer_depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, config.size.x, config.size.y);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, framebuffer_color);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, framebuffer_depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Error creating offscreen framebuffer." << std::endl;
+			return 1;
+		}
+		//(stays bound for the rest of the program)
+		glViewport(0, 0, config.size.x, config.size.y);
+	} else if (config.uncapped) {
+		if (SDL_GL_SetSwapInterval(0) != 0) {
+			std::cerr << "NOTE: couldn't turn off vsync (" << SDL_GetError() << ")." << std::endl;
+		}
+	} else {
+		//Set VSYNC + Late Swap (prevents crazy FPS):
+		if (SDL_GL_SetSwapInterval(-1) != 0) {
+			std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
+			if (SDL_GL_SetSwapInterval(1) != 0) {
+				std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
+			}
 		}
 	}
 
@@ -86,113 +206,114 @@ int main(int argc, char **argv) {
 
 	//------------ opengl objects / game assets ------------
 
-	//shader program:
-	GLuint program = 0;
-	GLuint program_Position = 0;
-	GLuint program_Normal = 0;
-	GLuint program_Color = 0;
-	GLuint program_mvp = 0;
-	GLuint program_itmv = 0;
-	GLuint program_to_light = 0;
-	{ //compile shader program:
-		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
-			"#version 330\n"
-			"uniform mat4 mvp;\n"
-			"uniform mat3 itmv;\n"
-			"in vec4 Position;\n"
-			"in vec3 Normal;\n"
-			"in vec3 Color;\n"
-			"out vec3 normal;\n"
-			"out vec3 color;\n"
-			"void main() {\n"
-			"	gl_Position = mvp * Position;\n"
-			"	normal = itmv * Normal;\n"
-			"	color = Color;\n"
-			"}\n"
-		);
-
-		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
-			"#version 330\n"
-			"uniform vec3 to_light;\n"
-			"in vec3 normal;\n"
-			"in vec3 color;\n"
-			"out vec4 fragColor;\n"
-			"void main() {\n"
-			"	float nl = dot(normalize(normal), to_light);\n"
-			"   vec3 ambience = color * 0.1;\n"
-			"	fragColor = vec4(ambience + (color / 3.1415926) * 2.5f * (smoothstep(0.0, 0.1, nl) * 0.6 + 0.4), 1.0);\n"
-			"}\n"
-		);
-
-		program = link_program(fragment_shader, vertex_shader);
-
-		//look up attribute locations:
-		program_Position = glGetAttribLocation(program, "Position");
-		if (program_Position == -1U) throw std::runtime_error("no attribute named Position");
-		program_Normal = glGetAttribLocation(program, "Normal");
-		if (program_Normal == -1U) throw std::runtime_error("no attribute named Normal");
-		program_Color = glGetAttribLocation(program, "Color");
-		if (program_Color == -1U) throw std::runtime_error("no attribute named Color");
-
-		//look up uniform locations:
-		program_mvp = glGetUniformLocation(program, "mvp");
-		if (program_mvp == -1U) throw std::runtime_error("no uniform named mvp");
-		program_itmv = glGetUniformLocation(program, "itmv");
-		if (program_itmv == -1U) throw std::runtime_error("no uniform named itmv");
-
-		program_to_light = glGetUniformLocation(program, "to_light");
-		if (program_to_light == -1U) throw std::runtime_error("no uniform named to_light");
-	}
+	//shader programs (one variant per way of passing matrices to them):
+	Programs programs;
 
 	//------------ meshes ------------
 
 	Meshes meshes;
 
-	{ //add meshes to database:
-		Meshes::Attributes attributes;
-		attributes.Position = program_Position;
-		attributes.Normal = program_Normal;
-		attributes.Color = program_Color;
+	auto print_mesh_stats = [&meshes]() {
+		std::cout << "Loaded " << meshes.stats.file_bytes << " bytes of meshes: " << meshes.stats.vertices << " vertices, "
+		          << meshes.stats.vertex_bytes << " bytes uploaded (" << (meshes.quantize ? "quantized" : "float") << ") in "
+		          << meshes.stats.upload_seconds * 1000.0 << " ms." << std::endl;
+	};
 
-		meshes.load("meshes.blob", attributes);
+	{ //add meshes to database -- in the background, so the game can start drawing right away:
+		meshes.quantize = !config.float_vertices;
+		meshes.load_async("meshes.blob", programs.attributes());
+		//...except when the frames should be repeatable:
+		if (config.headless || recording || replaying) {
+			meshes.finish();
+			print_mesh_stats();
+		}
 	}
 	
 	//------------ scene ------------
 
+	//worker threads for the (CPU side of) scene update:
+	ThreadPool pool;
+
 	Scene scene;
+	scene.pool = &pool;
 	//set up camera parameters based on window:
 	scene.camera.fovy = glm::radians(60.0f);
 	scene.camera.aspect = float(config.size.x) / float(config.size.y);
 	scene.camera.near = 0.01f;
+
+	{ //sun, shining (down its -z axis) from just above the camera's starting point:
+		scene.lights.emplace_back();
+		Scene::Light &sun = scene.lights.back();
+		sun.type = Scene::Light::Directional;
+		sun.transform.set_rotation(glm::angleAxis(std::atan2(1.0f, 10.0f), glm::vec3(-1.0f, 0.0f, 0.0f)));
+		sun.intensity = glm::vec3(2.5f);
+	}
 	//(transform will be handled in the update function below)
 
-	std::vector< Scene::Object * > robot;
+	std::vector< Scene::ObjectHandle > robot;
 
-	//add some objects from the mesh library:
-	auto add_object = [&](std::string const &name, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) -> Scene::Object & {
-		Mesh const &mesh = meshes.get(name);
-		scene.objects.emplace_back();
-		Scene::Object &object = scene.objects.back();
-		object.transform.position = position;
-		object.transform.rotation = rotation;
-		object.transform.scale = scale;
+	//how non-instanced objects get their matrices, switched with 'M' to compare driver overhead:
+	Programs::Mode matrices_mode = Programs::MultiDraw;
+
+	//point an object at a mesh from the library:
+	auto set_mesh = [](Scene::Object &object, Mesh const &mesh) {
 		object.vao = mesh.vao;
 		object.start = mesh.start;
 		object.count = mesh.count;
-		object.program = program;
-		object.program_mvp = program_mvp;
-		object.program_itmv = program_itmv;
-		robot.emplace_back(&object);
-		return object;
+		object.mesh_index = mesh.index;
+		object.bbox_min = mesh.bbox_min;
+		object.bbox_max = mesh.bbox_max;
+		object.sphere_center = mesh.sphere_center;
+		object.sphere_radius = mesh.sphere_radius;
+		object.dequantize_scale = mesh.dequantize_scale;
+		object.dequantize_offset = mesh.dequantize_offset;
+		for (uint32_t l = 0; l < mesh.lod_count; ++l) {
+			object.lods[l].start = mesh.lods[l].start;
+			object.lods[l].count = mesh.lods[l].count;
+			object.lods[l].error = mesh.lods[l].error;
+		}
+		object.lod_count = mesh.lod_count;
+	};
+
+	//objects waiting for their meshes to finish loading:
+	struct Waiting {
+		Scene::ObjectHandle handle;
+		MeshID id;
+		std::string name; //(for the warning if it never shows up)
+	};
+	std::vector< Waiting > waiting;
+
+	//point an object at a mesh from the library as soon as it is loaded:
+	auto attach_mesh = [&](Scene::ObjectHandle handle, MeshID id, char const *name) {
+		if (Mesh const *mesh = meshes.find(id)) {
+			set_mesh(scene.objects[handle], *mesh);
+		} else {
+			waiting.emplace_back(Waiting{handle, id, name});
+		}
+	};
+
+	//add some objects from the mesh library:
+	auto add_object = [&](std::string const &name, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) -> Scene::ObjectHandle {
+		Scene::ObjectHandle handle = scene.objects.emplace();
+		Scene::Object &object = scene.objects[handle];
+		object.transform.set_position(position);
+		object.transform.set_rotation(rotation);
+		object.transform.set_scale(scale);
+		programs.set(object, matrices_mode);
+		attach_mesh(handle, meshes.intern(name), name.c_str());
+		robot.emplace_back(handle);
+		return handle;
 	};
 
 
 	{ //read objects to add from "scene.blob":
 		std::ifstream file("scene.blob", std::ios::binary);
+		std::vector< BlobChunk > toc;
+		read_blob_toc(file, &toc);
 
 		std::vector< char > strings;
 		//read strings chunk:
-		read_chunk(file, "str0", &strings);
+		read_chunk(file, toc, "str0", &strings);
 
 		{ //read scene chunk, add meshes to scene:
 			struct SceneEntry {
@@ -204,7 +325,7 @@ int main(int argc, char **argv) {
 			static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
 
 			std::vector< SceneEntry > data;
-			read_chunk(file, "scn0", &data);
+			read_chunk(file, toc, "scn0", &data);
 
 			for (auto const &entry : data) {
 				if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -225,22 +346,25 @@ int main(int argc, char **argv) {
 	// manually set up transforms for hierarchy because everything was exported in world
 	// instead of local space for some reason. also, I don't understand how blender
 	// shows parent-child coordinates. x and y seem relative but z is absolute?
-	robot[3]->transform.position = glm::vec3(0.0f, 0.0f, 0.0f);
-	robot[3]->transform.rotation = glm::quat(base_rot);
-	robot[11]->transform.position = glm::vec3(0.0f, 0.0f, 0.6f);
-	robot[11]->transform.rotation = glm::quat(link1_rot);
-	robot[12]->transform.position = glm::vec3(0.0f, 0.0f, 1.80318f - 0.6f);
-	robot[12]->transform.rotation = glm::quat(link2_rot);
-	robot[13]->transform.position = glm::vec3(0.0f, 0.0f, 2.99981f - 1.80318f);
-	robot[13]->transform.rotation = glm::quat(link3_rot);
-	robot[11]->transform.set_parent(&robot[3]->transform);
-	robot[12]->transform.set_parent(&robot[11]->transform);
-	robot[13]->transform.set_parent(&robot[12]->transform);
+	scene.objects[robot[3]].transform.set_position(glm::vec3(0.0f, 0.0f, 0.0f));
+	scene.objects[robot[3]].transform.set_rotation(glm::quat(base_rot));
+	scene.objects[robot[11]].transform.set_position(glm::vec3(0.0f, 0.0f, 0.6f));
+	scene.objects[robot[11]].transform.set_rotation(glm::quat(link1_rot));
+	scene.objects[robot[12]].transform.set_position(glm::vec3(0.0f, 0.0f, 1.80318f - 0.6f));
+	scene.objects[robot[12]].transform.set_rotation(glm::quat(link2_rot));
+	scene.objects[robot[13]].transform.set_position(glm::vec3(0.0f, 0.0f, 2.99981f - 1.80318f));
+	scene.objects[robot[13]].transform.set_rotation(glm::quat(link3_rot));
+	scene.objects[robot[11]].transform.set_parent(&scene.objects[robot[3]].transform);
+	scene.objects[robot[12]].transform.set_parent(&scene.objects[robot[11]].transform);
+	scene.objects[robot[13]].transform.set_parent(&scene.objects[robot[12]].transform);
 
 	glm::vec4 nail = glm::vec4(0.0f, 0.0f, 0.5f, 1.0f);
 	float balloon[] = { 1.0f, -1.0f, 2.0f };
 	bool popped[3] = { false };
 	int num_left = 3;
+	//(popped balloons swap to these meshes; their names are interned once, up front)
+	static char const * const PoppedNames[3] = { "Balloon1-Pop", "Balloon2-Pop", "Balloon3-Pop" };
+	MeshID const PoppedIds[3] = { meshes.intern(PoppedNames[0]), meshes.intern(PoppedNames[1]), meshes.intern(PoppedNames[2]) };
 
 	glm::vec2 mouse = glm::vec2(0.0f, 0.0f); //mouse position in [-1,1]x[-1,1] coordinates
 
@@ -253,24 +377,83 @@ int main(int argc, char **argv) {
 
 	//------------ game loop ------------
 
+	//CPU time spent in scene.render(), reported when switching matrix upload paths:
+	double render_seconds = 0.0;
+	uint32_t render_frames = 0;
+
+	//GPU time spent in each pass, reported along with render() time:
+	GPUTimers gpu_timers;
+	auto print_gpu_times = [&gpu_timers]() {
+		if (gpu_timers.totals.empty()) return;
+		std::cout << "GPU:";
+		for (auto const &total : gpu_timers.totals) {
+			std::cout << " " << total.name << " " << (total.seconds / total.count * 1000.0) << " ms";
+		}
+		std::cout << " (averages over " << gpu_timers.totals[0].count << " frames";
+		if (gpu_timers.dropped) std::cout << "; " << gpu_timers.dropped << " frames' results arrived too late";
+		std::cout << ")." << std::endl;
+	};
+
+	//for the timing summary when running a fixed number of frames:
+	uint32_t frame = 0;
+	auto first_frame_time = std::chrono::high_resolution_clock::now();
+
 	bool should_quit = false;
+	//next event to handle -- from SDL, or from the log when replaying:
+	auto poll_event = [&](SDL_Event *evt) {
+		if (replaying) {
+			//live input is ignored, except for quitting:
+			while (SDL_PollEvent(evt) == 1) {
+				if (evt->type == SDL_QUIT || (evt->type == SDL_KEYDOWN && evt->key.keysym.sym == SDLK_ESCAPE)) return true;
+			}
+			return input_log.next_event(evt);
+		}
+		if (SDL_PollEvent(evt) != 1) return false;
+		if (recording) input_log.record_event(*evt);
+		return true;
+	};
+
 	while (true) {
-		static SDL_Event evt;
-		while (SDL_PollEvent(&evt) == 1) {
-			//handle input:
-			if (evt.type == SDL_MOUSEMOTION) {
-				glm::vec2 old_mouse = mouse;
-				mouse.x = (evt.motion.x + 0.5f) / float(config.size.x) * 2.0f - 1.0f;
-				mouse.y = (evt.motion.y + 0.5f) / float(config.size.y) *-2.0f + 1.0f;
-				if (evt.motion.state & SDL_BUTTON(SDL_BUTTON_LEFT)) {
-					camera.elevation += -2.0f * (mouse.y - old_mouse.y);
-					camera.azimuth += -2.0f * (mouse.x - old_mouse.x);
+		if (replaying && !input_log.next_frame()) break;
+
+		{ //handle events:
+			PROFILE_ZONE("events");
+			static SDL_Event evt;
+			while (poll_event(&evt)) {
+				//handle input:
+				if (evt.type == SDL_MOUSEMOTION) {
+					glm::vec2 old_mouse = mouse;
+					mouse.x = (evt.motion.x + 0.5f) / float(config.size.x) * 2.0f - 1.0f;
+					mouse.y = (evt.motion.y + 0.5f) / float(config.size.y) *-2.0f + 1.0f;
+					if (evt.motion.state & SDL_BUTTON(SDL_BUTTON_LEFT)) {
+						camera.elevation += -2.0f * (mouse.y - old_mouse.y);
+						camera.azimuth += -2.0f * (mouse.x - old_mouse.x);
+					}
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_ESCAPE) {
+					should_quit = true;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_m) {
+					if (render_frames) {
+						std::cout << "render(): " << (render_seconds / render_frames * 1000.0) << " ms/frame over " << render_frames << " frames with "
+							<< Programs::mode_name(matrices_mode) << " (" << scene.stats.draw_calls << " draw calls)." << std::endl;
+						print_gpu_times();
+					}
+					render_seconds = 0.0;
+					render_frames = 0;
+					gpu_timers.reset_totals();
+					matrices_mode = (matrices_mode == Programs::MultiDraw ? Programs::UniformBuffer : matrices_mode == Programs::UniformBuffer ? Programs::Uniforms : Programs::MultiDraw);
+					for (uint32_t i = 0; i < scene.objects.size(); ++i) {
+						programs.set(scene.objects.data()[i], matrices_mode);
+					}
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_p) {
+					if (Profiler::write_trace("trace.json", TraceFrames)) {
+						std::cout << "Wrote the last " << TraceFrames << " frames' profile to 'trace.json'." << std::endl;
+					} else {
+						std::cerr << "Failed to write 'trace.json'." << std::endl;
+					}
+				} else if (evt.type == SDL_QUIT) {
+					should_quit = true;
+					break;
 				}
-			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_ESCAPE) {
-				should_quit = true;
-			} else if (evt.type == SDL_QUIT) {
-				should_quit = true;
-				break;
 			}
 		}
 		if (should_quit) break;
@@ -279,16 +462,40 @@ int main(int argc, char **argv) {
 		static auto previous_time = current_time;
 		float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
 		previous_time = current_time;
+		//(headless runs should be repeatable, so they step by a fixed 1/60th of a second)
+		if (config.headless) elapsed = 1.0f / 60.0f;
+		//(replays reuse the recorded steps, so everything moves exactly as it did)
+		if (replaying) elapsed = input_log.elapsed();
+		if (recording) input_log.record_frame(SDL_GetKeyboardState(NULL), elapsed);
+
+		if (meshes.loading() || !waiting.empty()) { //stream in meshes, and show objects whose meshes arrived:
+			meshes.update(config.upload_budget);
+			for (auto w = waiting.begin(); w != waiting.end(); ) {
+				Mesh const *mesh = meshes.find(w->id);
+				Scene::Object *object = scene.objects.get(w->handle); //(may have been removed while waiting)
+				if (mesh && object) set_mesh(*object, *mesh);
+				if (mesh || !object) w = waiting.erase(w);
+				else ++w;
+			}
+			if (!meshes.loading()) {
+				for (auto const &w : waiting) {
+					std::cerr << "WARNING: no mesh named '" << w.name << "' was loaded." << std::endl;
+				}
+				waiting.clear();
+				print_mesh_stats();
+			}
+		}
 
 		{ //update game state:
-			static const Uint8* state = SDL_GetKeyboardState(NULL);
+			PROFILE_ZONE("update");
+			const Uint8* state = (replaying ? input_log.keyboard() : SDL_GetKeyboardState(NULL));
 			const float step = 2.0f;
 
 			// insert stupid, slow code
-			glm::quat a = robot[3]->transform.rotation;
-			glm::quat b = robot[11]->transform.rotation;
-			glm::quat c = robot[12]->transform.rotation;
-			glm::quat d = robot[13]->transform.rotation;
+			glm::quat a = scene.objects[robot[3]].transform.rotation;
+			glm::quat b = scene.objects[robot[11]].transform.rotation;
+			glm::quat c = scene.objects[robot[12]].transform.rotation;
+			glm::quat d = scene.objects[robot[13]].transform.rotation;
 			float e = base_rot.z;
 			float f = link1_rot.x;
 			float g = link2_rot.x;
@@ -325,21 +532,21 @@ int main(int argc, char **argv) {
 				if (link3_rot.x <= -2.7f) link3_rot.x = -2.7f; // empirical
 			}
 
-			robot[3]->transform.rotation = glm::quat(base_rot);
-			robot[11]->transform.rotation = glm::quat(link1_rot);
-			robot[12]->transform.rotation = glm::quat(link2_rot);
-			robot[13]->transform.rotation = glm::quat(link3_rot);
+			scene.objects[robot[3]].transform.set_rotation(glm::quat(base_rot));
+			scene.objects[robot[11]].transform.set_rotation(glm::quat(link1_rot));
+			scene.objects[robot[12]].transform.set_rotation(glm::quat(link2_rot));
+			scene.objects[robot[13]].transform.set_rotation(glm::quat(link3_rot));
 
 			// stupid, slow code to check the nail piece for collision w/ ground
 			// still clips on the stand though
-			glm::mat4 local_to_world = robot[13]->transform.make_local_to_world();
+			glm::mat4 const &local_to_world = scene.objects[robot[13]].transform.make_local_to_world();
 			glm::vec3 pos = local_to_world * nail;
 			glm::vec3 pos2 = local_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 			if (pos.z < 0.0f || pos2.z < 0.25f) {
-				robot[3]->transform.rotation = a;
-				robot[11]->transform.rotation = b;
-				robot[12]->transform.rotation = c;
-				robot[13]->transform.rotation = d;
+				scene.objects[robot[3]].transform.set_rotation(a);
+				scene.objects[robot[11]].transform.set_rotation(b);
+				scene.objects[robot[12]].transform.set_rotation(c);
+				scene.objects[robot[13]].transform.set_rotation(d);
 				base_rot.z = e;
 				link1_rot.x = f;
 				link2_rot.x = g;
@@ -348,131 +555,142 @@ int main(int argc, char **argv) {
 
 			for (int i = 0; i < 3; i++) {
 				if (!popped[i]) {
-					robot[i]->transform.position.z += elapsed * balloon[i];
-					if (robot[i]->transform.position.z <= 0.6f) {
-						robot[i]->transform.position.z = 0.6f;
+					Scene::Object &object = scene.objects[robot[i]];
+					object.transform.position.z += elapsed * balloon[i];
+					if (object.transform.position.z <= 0.6f) {
+						object.transform.position.z = 0.6f;
 						balloon[i] *= -1.0f;
-					} else if (robot[i]->transform.position.z > 4.5f) {
-						robot[i]->transform.position.z = 4.5f;
+					} else if (object.transform.position.z > 4.5f) {
+						object.transform.position.z = 4.5f;
 						balloon[i] *= -1.0f;
 					}
-					glm::vec3 diff = pos - robot[i]->transform.position;
+					object.transform.mark_dirty();
+					glm::vec3 diff = pos - object.transform.position;
 					if (diff.x * diff.x + diff.y * diff.y + diff.z * diff.z <= 0.6f * 0.6f) {
 						popped[i] = true;
 						balloon[i] = 0.2f;
 						// replace instead of deleting. shortcut code
-						Mesh const &mesh = meshes.get("Balloon" + std::to_string(i + 1) + "-Pop");
-						robot[i]->vao = mesh.vao;
-						robot[i]->start = mesh.start;
-						robot[i]->count = mesh.count;
+						attach_mesh(robot[i], PoppedIds[i], PoppedNames[i]);
 						if (--num_left == 0)
 							std::cout << "You win!" << std::endl;
 					}
 				} else if (balloon[i] > 0.0f) {
 					balloon[i] -= elapsed;
 					if (balloon[i] <= 0.0f) {
-						GLuint start = robot[i]->start;
-						for (auto it = scene.objects.begin(); it != scene.objects.end(); it++) {
-							// comparing by mesh rather than some id ... :S
-							if (it->start == start) {
-								scene.objects.erase(it);
-								break;
-							}
-						}
+						scene.remove_object(robot[i]);
 					}
 				}
 			}
 
-			//camera:
-			scene.camera.transform.position = camera.radius * glm::vec3(
-				std::cos(camera.elevation) * std::cos(camera.azimuth),
-				std::cos(camera.elevation) * std::sin(camera.azimuth),
-				std::sin(camera.elevation)) + camera.target;
-
-			glm::vec3 out = -glm::normalize(camera.target - scene.camera.transform.position);
-			glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
-			up = glm::normalize(up - glm::dot(up, out) * out);
-			glm::vec3 right = glm::cross(up, out);
+			{ //camera:
+				PROFILE_ZONE("camera");
+				scene.camera.transform.set_position(camera.radius * glm::vec3(
+					std::cos(camera.elevation) * std::cos(camera.azimuth),
+					std::cos(camera.elevation) * std::sin(camera.azimuth),
+					std::sin(camera.elevation)) + camera.target);
+
+				glm::vec3 out = -glm::normalize(camera.target - scene.camera.transform.position);
+				glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+				up = glm::normalize(up - glm::dot(up, out) * out);
+				glm::vec3 right = glm::cross(up, out);
 			
-			scene.camera.transform.rotation = glm::quat_cast(
-				glm::mat3(right, up, out)
-			);
-			scene.camera.transform.scale = glm::vec3(1.0f, 1.0f, 1.0f);
+				scene.camera.transform.set_rotation(glm::quat_cast(
+					glm::mat3(right, up, out)
+				));
+				scene.camera.transform.set_scale(glm::vec3(1.0f, 1.0f, 1.0f));
+			}
 		}
 
 		//draw output:
+		gpu_timers.begin("clear");
 		glClearColor(0.5, 0.5, 0.5, 0.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		gpu_timers.end();
 		glEnable(GL_DEPTH_TEST);
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
 		{ //draw game state:
-			glUseProgram(program);
-			
 			// lights. camera. action
-			glm::vec3 light_in_camera = glm::mat3(scene.camera.transform.make_world_to_local()) * glm::vec3(0.0f, 1.0f, 10.0f);
-			glUniform3fv(program_to_light, 1, glm::value_ptr(glm::normalize(light_in_camera)));
+			auto before = std::chrono::high_resolution_clock::now();
+			gpu_timers.begin("scene");
 			scene.render();
+			gpu_timers.end();
+			render_seconds += std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+			render_frames += 1;
 		}
 
+		++frame;
+		bool last_frame = (config.frames != 0 && frame == config.frames);
+
+		if (last_frame && !config.png.empty()) {
+			//read back before swapping (after which the back buffer's contents are undefined):
+			std::vector< uint32_t > pixels(config.size.x * config.size.y);
+			gpu_timers.begin("readback");
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, config.size.x, config.size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			gpu_timers.end();
+			for (auto &pixel : pixels) {
+				pixel |= 0xff000000; //(clear color has zero alpha)
+			}
+			save_png(config.png, config.size.x, config.size.y, pixels.data(), LowerLeftOrigin);
+			std::cout << "Saved frame " << frame << " to '" << config.png << "'." << std::endl;
+		}
 
-		SDL_GL_SwapWindow(window);
+		{ //present:
+			PROFILE_ZONE("swap");
+			if (config.headless) {
+				//nothing paces frames without a swap, so wait for each one to finish:
+				glFinish();
+			} else {
+				SDL_GL_SwapWindow(window);
+			}
+		}
+		gpu_timers.frame();
+		PROFILE_FRAME();
+
+		if (last_frame) {
+			double seconds = std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - first_frame_time).count();
+			std::cout << frame << " frames in " << seconds << " s: " << (seconds / frame * 1000.0) << " ms/frame, "
+			          << (render_seconds / render_frames * 1000.0) << " ms/frame in render() with " << Programs::mode_name(matrices_mode)
+			          << " (" << scene.stats.draw_calls << " draw calls)." << std::endl;
+			gpu_timers.finish();
+			print_gpu_times();
+			break;
+		}
 	}
 
 
-	//------------  teardown ------------
-
-	SDL_GL_DeleteContext(context);
-	context = 0;
+	if (recording) {
+		input_log.save(config.record);
+		std::cout << "Recorded " << input_log.frame_count() << " frames of input to '" << config.record << "'." << std::endl;
+	}
 
-	SDL_DestroyWindow(window);
-	window = NULL;
+	if (!config.trace.empty()) {
+		if (Profiler::write_trace(config.trace, TraceFrames)) {
+			std::cout << "Wrote the last " << TraceFrames << " frames' profile to '" << config.trace << "'." << std::endl;
+		} else {
+			std::cerr << "Failed to write '" << config.trace << "'." << std::endl;
+		}
+	}
 
-	return 0;
-}
+	//------------  teardown ------------
 
+	gpu_timers.release();
 
+	if (config.headless) {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &framebuffer_color);
+		glDeleteRenderbuffers(1, &framebuffer_depth);
+		//(context is cleaned up by ~Headless)
+	} else {
+		SDL_GL_DeleteContext(context);
+		context = 0;
 
-static GLuint compile_shader(GLenum type, std::string const &source) {
-	GLuint shader = glCreateShader(type);
-	GLchar const *str = source.c_str();
-	GLint length = source.size();
-	glShaderSource(shader, 1, &str, &length);
-	glCompileShader(shader);
-	GLint compile_status = GL_FALSE;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-	if (compile_status != GL_TRUE) {
-		std::cerr << "Failed to compile shader." << std::endl;
-		GLint info_log_length = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetShaderInfoLog(shader, info_log.size(), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		glDeleteShader(shader);
-		throw std::runtime_error("Failed to compile shader.");
+		SDL_DestroyWindow(window);
+		window = NULL;
 	}
-	return shader;
-}
 
-static GLuint link_program(GLuint fragment_shader, GLuint vertex_shader) {
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
-	glLinkProgram(program);
-	GLint link_status = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
-	if (link_status != GL_TRUE) {
-		std::cerr << "Failed to link shader program." << std::endl;
-		GLint info_log_length = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetProgramInfoLog(program, info_log.size(), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		throw std::runtime_error("Failed to link program");
-	}
-	return program;
+	return 0;
 }
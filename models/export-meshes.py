@@ -11,9 +11,44 @@ import sys
 
 import bpy
 import struct
+import zlib
+
+#write a version 2 blob (see Blob.hpp): header, table of contents, then each chunk's data at a multiple of its alignment.
+#chunks are (magic, data, alignment) tuples:
+def write_blob(filename, chunks):
+	blob = open(filename, 'wb')
+	offset = 16 + 32 * len(chunks)
+	toc = b''
+	for (magic, data, alignment) in chunks:
+		offset = (offset + alignment - 1) // alignment * alignment
+		toc += struct.pack('<4sIQQII', magic, alignment, offset, len(data), zlib.crc32(data) & 0xffffffff, 1) #(1: has checksum)
+		offset += len(data)
+	blob.write(struct.pack('<4sIII', b'blob', 2, len(chunks), 0))
+	blob.write(toc)
+	for (magic, data, alignment) in chunks:
+		blob.write(b'\0' * ((alignment - blob.tell() % alignment) % alignment))
+		blob.write(data)
+	return blob.tell()
 
 bpy.ops.wm.open_mainfile(filepath='robot.blend')
 
+#write quantized vertices ('q16v' and 'idxq' chunks, 16 bytes per vertex) rather than full-precision ones ('v3n3' and 'idx0', 36 bytes per vertex):
+quantize = True
+
+#pack a vertex as Meshes::PackedVertex -- position relative to the mesh's box, 10-bit normal, 8-bit color:
+def quantized_vertex(co, normal, color, box_min, box_max):
+	position = []
+	for c in range(0,3):
+		extent = box_max[c] - box_min[c]
+		t = (co[c] - box_min[c]) / extent if extent > 0.0 else 0.0
+		position.append(int(round(min(max(t, 0.0), 1.0) * 65535.0)))
+	packed_normal = 0
+	for c in range(0,3):
+		n = int(round(min(max(normal[c], -1.0), 1.0) * 511.0))
+		packed_normal |= (n & 0x3ff) << (10 * c)
+	rgb = [int(round(min(max(x, 0.0), 1.0) * 255.0)) for x in color[0:3]]
+	return struct.pack('4H', position[0], position[1], position[2], 0) + struct.pack('I', packed_normal) + struct.pack('4B', rgb[0], rgb[1], rgb[2], 255)
+
 #names of objects whose meshes to write (not actually the names of the meshes):
 to_write = [
 	'Balloon1',
@@ -82,40 +117,46 @@ for name in to_write:
 	index += struct.pack('I', vertex_count)
 	index += struct.pack('I', len(mesh.polygons) * 3)
 
-	#write the mesh:
+	#gather the mesh's (position, normal, color) triples:
+	verts = []
 	for poly in mesh.polygons:
 		assert(len(poly.loop_indices) == 3)
 		for i in range(0,3):
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			loop = mesh.loops[poly.loop_indices[i]]
 			vertex = mesh.vertices[loop.vertex_index]
-			for x in vertex.co:
-				data += struct.pack('f', x)
-			for x in loop.normal:
-				data += struct.pack('f', x)
-			for x in colors[poly.loop_indices[i]].color:
-				data += struct.pack('f', x)
+			verts.append((tuple(vertex.co), tuple(loop.normal), tuple(colors[poly.loop_indices[i]].color)))
+
+	#write the mesh:
+	if quantize:
+		#(quantized positions are relative to the mesh's box, which goes in the index)
+		box_min = [min(v[0][c] for v in verts) for c in range(0,3)]
+		box_max = [max(v[0][c] for v in verts) for c in range(0,3)]
+		index += struct.pack('3f', *box_min)
+		index += struct.pack('3f', *box_max)
+		for (co, normal, color) in verts:
+			data += quantized_vertex(co, normal, color, box_min, box_max)
+	else:
+		for (co, normal, color) in verts:
+			data += struct.pack('3f', *co)
+			data += struct.pack('3f', *normal)
+			data += struct.pack('3f', *color[0:3])
 	vertex_count += len(mesh.polygons) * 3
 
 #check that we wrote as much data as anticipated:
-assert(vertex_count * (3 * 4 + 3 * 4 + 3 * 4) == len(data))
-
-#write the data chunk and index chunk to an output blob:
-blob = open('meshes.blob', 'wb')
-#first chunk: the data
-blob.write(struct.pack('4s',b'v3n3')) #type
-blob.write(struct.pack('I', len(data))) #length
-blob.write(data)
-#second chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#third chunk: the index
-blob.write(struct.pack('4s',b'idx0')) #type
-blob.write(struct.pack('I', len(index))) #length
-blob.write(index)
-
-print("Wrote " + str(blob.tell()) + " bytes to meshes.blob")
+if quantize:
+	assert(vertex_count * 16 == len(data))
+else:
+	assert(vertex_count * (3 * 4 + 3 * 4 + 3 * 4) == len(data))
+
+#write the data chunk (cache-line aligned), strings chunk, and index chunk to an output blob:
+size = write_blob('meshes.blob', [
+	(b'q16v' if quantize else b'v3n3', data, 64),
+	(b'str0', strings, 16),
+	(b'idxq' if quantize else b'idx0', index, 16),
+])
+
+print("Wrote " + str(size) + " bytes to meshes.blob")
 
 #---------------------------------------------------------------------
 #Export scene (object positions for every object on layer one)
@@ -149,15 +190,10 @@ for obj in bpy.data.objects:
 	scene += struct.pack('3f', transform[2].x, transform[2].y, transform[2].z)
 
 #write the strings chunk and scene chunk to an output blob:
-blob = open('scene.blob', 'wb')
-#first chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#second chunk: the scene
-blob.write(struct.pack('4s',b'scn0')) #type
-blob.write(struct.pack('I', len(scene))) #length
-blob.write(scene)
-
-print("Wrote " + str(blob.tell()) + " bytes to scene.blob")
+size = write_blob('scene.blob', [
+	(b'str0', strings, 16),
+	(b'scn0', scene, 16),
+])
+
+print("Wrote " + str(size) + " bytes to scene.blob")
 
@@ -1,35 +1,75 @@
 #pragma once
 
+#include "Blob.hpp"
+
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
 
+//read the chunk with the given (four-character) magic from a blob whose table of contents
+// (see read_blob_toc() in Blob.hpp) was read from 'from':
+// note: will throw if there is no such chunk, or it has the wrong size or a bad checksum.
 template< typename T >
-void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *_to) {
+void read_chunk(std::istream &from, std::vector< BlobChunk > const &toc, std::string const &magic, std::vector< T > *_to) {
 	assert(_to);
 	auto &to = *_to;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-
-	ChunkHeader header;
-	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
-		throw std::runtime_error("Failed to read chunk header");
+	BlobChunk const *chunk = find_chunk(toc, magic);
+	if (!chunk) {
+		throw std::runtime_error("Missing '" + magic + "' chunk");
 	}
-	if (std::string(header.magic,4) != magic) {
-		throw std::runtime_error("Unexpected magic number in chunk");
+	if (chunk->size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
 
-	if (header.size % sizeof(T) != 0) {
+	to.resize(size_t(chunk->size / sizeof(T)));
+	from.clear();
+	if (!from.seekg(std::streamoff(chunk->offset)) || !from.read(reinterpret_cast< char * >(to.data()), to.size() * sizeof(T))) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	check_chunk(*chunk, to.data());
+}
+
+//ChunkView is a chunk's elements where they sit in memory (e.g., in a MappedFile):
+template< typename T >
+struct ChunkView {
+	T const *data = nullptr;
+	size_t size = 0;
+	T const *begin() const { return data; }
+	T const *end() const { return data + size; }
+	T const &operator[](size_t i) const { return data[i]; }
+};
+
+//read the chunk with the given magic from a blob that is in memory at 'blob' (e.g., in a MappedFile):
+// the view points right at the chunk's data unless that isn't aligned for T (only possible in
+// older blobs), in which case the data is copied to *scratch and the view points there.
+// note: will throw if there is no such chunk, or it has the wrong size or a bad checksum.
+template< typename T >
+ChunkView< T > read_chunk(char const *blob, std::vector< BlobChunk > const &toc, std::string const &magic, std::vector< T > *scratch) {
+	assert(scratch);
+
+	BlobChunk const *chunk = find_chunk(toc, magic);
+	if (!chunk) {
+		throw std::runtime_error("Missing '" + magic + "' chunk");
+	}
+	if (chunk->size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
+	char const *begin = blob + chunk->offset;
+	check_chunk(*chunk, begin);
 
-	to.resize(header.size / sizeof(T));
-	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
-		throw std::runtime_error("Failed to read chunk data.");
+	ChunkView< T > view;
+	view.size = size_t(chunk->size / sizeof(T));
+	if (reinterpret_cast< uintptr_t >(begin) % alignof(T) == 0) {
+		view.data = reinterpret_cast< T const * >(begin);
+	} else {
+		scratch->resize(view.size);
+		std::memcpy(scratch->data(), begin, size_t(chunk->size));
+		view.data = scratch->data();
 	}
+	return view;
 }
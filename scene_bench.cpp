@@ -0,0 +1,545 @@
+#include "GL.hpp"
+#include "Meshes.hpp"
+#include "Programs.hpp"
+#include "Scene.hpp"
+#include "Headless.hpp"
+#include "Profiler.hpp"
+#include "GPUTimers.hpp"
+
+#include <SDL.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//scene_bench: update + render procedurally generated scenes, to see how frame costs scale.
+// usage: scene_bench [--objects N] [--depth D] [--reuse R] [--lights L] [--frames F] ... (see --help)
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const float Pi = 3.14159265358979f; //(M_PI isn't standard)
+
+static double ms_since(Clock::time_point const &before) {
+	return std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+}
+
+//summary of per-frame samples:
+struct Summary {
+	double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;
+};
+static Summary summarize(std::vector< double > samples) {
+	Summary summary;
+	if (samples.empty()) return summary;
+	std::sort(samples.begin(), samples.end());
+	//nearest-rank percentiles:
+	auto percentile = [&samples](double p) {
+		size_t rank = size_t(std::ceil(p * samples.size()));
+		return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+	};
+	for (auto sample : samples) {
+		summary.mean += sample;
+	}
+	summary.mean /= samples.size();
+	summary.p50 = percentile(0.50);
+	summary.p90 = percentile(0.90);
+	summary.p99 = percentile(0.99);
+	summary.max = samples.back();
+	return summary;
+}
+
+//a box (flat shaded) or a sphere (smooth shaded, 'detail' times as finely divided as usual) of random size and color, as unrolled triangles:
+static void make_mesh(std::mt19937 &mt, uint32_t detail, std::vector< Meshes::Vertex > *vertices) {
+	auto random = [&mt](float min, float max) { return min + (max - min) * (mt() % 10000) * 0.0001f; };
+	glm::vec3 color = glm::vec3(random(0.2f, 1.0f), random(0.2f, 1.0f), random(0.2f, 1.0f));
+	glm::vec3 radius = glm::vec3(random(0.2f, 0.6f), random(0.2f, 0.6f), random(0.2f, 0.6f));
+	bool smooth = (mt() % 2 == 0);
+	//(both shapes are convex and centered on the origin, so outward is away from it)
+	auto triangle = [&](glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+		glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+		bool flip = (glm::dot(normal, a + b + c) < 0.0f);
+		for (glm::vec3 const &p : {a, flip ? c : b, flip ? b : c}) {
+			Meshes::Vertex vertex;
+			vertex.position = p;
+			//(the ellipsoid's normal is its position scaled by 1 / radius^2)
+			vertex.normal = (smooth ? glm::normalize(p / (radius * radius)) : (flip ? -normal : normal));
+			vertex.color = color;
+			vertices->emplace_back(vertex);
+		}
+	};
+
+	if (!smooth) {
+		for (int axis = 0; axis < 3; ++axis) {
+			for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f) {
+				glm::vec3 n = glm::vec3(0.0f), u = glm::vec3(0.0f), v = glm::vec3(0.0f);
+				n[axis] = sign * radius[axis];
+				u[(axis + 1) % 3] = radius[(axis + 1) % 3];
+				v[(axis + 2) % 3] = sign * radius[(axis + 2) % 3];
+				triangle(n - u - v, n + u - v, n + u + v);
+				triangle(n - u - v, n + u + v, n - u + v);
+			}
+		}
+	} else {
+		uint32_t slices = (6 + mt() % 11) * detail;
+		uint32_t stacks = slices / 2;
+		auto point = [&](uint32_t slice, uint32_t stack) {
+			float theta = 2.0f * Pi * slice / slices;
+			float phi = Pi * stack / stacks;
+			return radius * glm::vec3(std::cos(theta) * std::sin(phi), std::sin(theta) * std::sin(phi), std::cos(phi));
+		};
+		for (uint32_t stack = 0; stack < stacks; ++stack) {
+			for (uint32_t slice = 0; slice < slices; ++slice) {
+				glm::vec3 a = point(slice, stack), b = point(slice, stack + 1);
+				glm::vec3 c = point(slice + 1, stack + 1), d = point(slice + 1, stack);
+				if (stack != 0) triangle(a, b, d);
+				if (stack + 1 != stacks) triangle(b, c, d);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	//Configuration:
+	struct {
+		uint32_t objects = 10000;
+		uint32_t depth = 4; //longest parent chain (1 means every object is a root)
+		float reuse = 50.0f; //objects per distinct mesh
+		uint32_t lights = 64; //point lights (there is always a sun as well)
+		float moving = 1.0f; //fraction of objects animated every frame
+		uint32_t frames = 200;
+		uint32_t warmup = 10; //frames to run before timing (the first few build the BVH, etc.)
+		uint32_t threads = ThreadPool::default_workers() + 1;
+		Programs::Mode mode = Programs::MultiDraw;
+		bool quantize = true; //upload 16-byte quantized vertices rather than 36-byte float ones
+		bool lods = true; //build levels of detail for meshes, and draw distant objects with them
+		uint32_t detail = 1; //multiplier on sphere tessellation
+		glm::uvec2 size = glm::uvec2(1280, 720);
+		uint32_t seed = 1;
+		std::string json; //if set, also save results here
+		std::string trace; //if set, write a Chrome trace of the last frames here
+	} config;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--objects" && argi + 1 < argc) {
+			config.objects = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--depth" && argi + 1 < argc) {
+			config.depth = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--reuse" && argi + 1 < argc) {
+			config.reuse = std::max(1.0f, std::stof(argv[++argi]));
+		} else if (arg == "--lights" && argi + 1 < argc) {
+			config.lights = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--moving" && argi + 1 < argc) {
+			config.moving = std::min(1.0f, std::max(0.0f, std::stof(argv[++argi])));
+		} else if (arg == "--frames" && argi + 1 < argc) {
+			config.frames = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--warmup" && argi + 1 < argc) {
+			config.warmup = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--threads" && argi + 1 < argc) {
+			config.threads = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--mode" && argi + 1 < argc && std::string(argv[argi + 1]) == "multidraw") {
+			config.mode = Programs::MultiDraw;
+			++argi;
+		} else if (arg == "--mode" && argi + 1 < argc && std::string(argv[argi + 1]) == "ubo") {
+			config.mode = Programs::UniformBuffer;
+			++argi;
+		} else if (arg == "--mode" && argi + 1 < argc && std::string(argv[argi + 1]) == "uniforms") {
+			config.mode = Programs::Uniforms;
+			++argi;
+		} else if (arg == "--vertices" && argi + 1 < argc && std::string(argv[argi + 1]) == "quantized") {
+			config.quantize = true;
+			++argi;
+		} else if (arg == "--vertices" && argi + 1 < argc && std::string(argv[argi + 1]) == "float") {
+			config.quantize = false;
+			++argi;
+		} else if (arg == "--lods" && argi + 1 < argc && std::string(argv[argi + 1]) == "on") {
+			config.lods = true;
+			++argi;
+		} else if (arg == "--lods" && argi + 1 < argc && std::string(argv[argi + 1]) == "off") {
+			config.lods = false;
+			++argi;
+		} else if (arg == "--detail" && argi + 1 < argc) {
+			config.detail = std::max(1U, uint32_t(std::stoul(argv[++argi])));
+		} else if (arg == "--size" && argi + 1 < argc && std::string(argv[argi + 1]).find('x') != std::string::npos) {
+			std::string value = argv[++argi];
+			config.size.x = uint32_t(std::stoul(value.substr(0, value.find('x'))));
+			config.size.y = uint32_t(std::stoul(value.substr(value.find('x') + 1)));
+		} else if (arg == "--seed" && argi + 1 < argc) {
+			config.seed = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--json" && argi + 1 < argc) {
+			config.json = argv[++argi];
+		} else if (arg == "--trace" && argi + 1 < argc) {
+			config.trace = argv[++argi];
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [options]\n"
+			          << "--objects N      objects in the scene (" << config.objects << ")\n"
+			          << "--depth D        longest parent chain in the transform hierarchy (" << config.depth << ")\n"
+			          << "--reuse R        objects per distinct mesh (" << config.reuse << ")\n"
+			          << "--lights L       point lights, in addition to a sun (" << config.lights << ")\n"
+			          << "--moving F       fraction of objects animated each frame (" << config.moving << ")\n"
+			          << "--frames F       frames to time (" << config.frames << "), after --warmup W (" << config.warmup << ")\n"
+			          << "--threads T      threads for Scene::prepare (" << config.threads << ")\n"
+			          << "--mode M         multidraw, ubo, or uniforms (how non-instanced draws get matrices)\n"
+			          << "--vertices V     quantized or float (vertex format uploaded)\n"
+			          << "--lods L         on or off (simplified levels of detail for distant objects)\n"
+			          << "--detail D       sphere tessellation multiplier (" << config.detail << ")\n"
+			          << "--size WxH       render target size (" << config.size.x << "x" << config.size.y << ")\n"
+			          << "--seed S         random seed (" << config.seed << ")\n"
+			          << "--json FILE      also save results as JSON\n"
+			          << "--trace FILE     write a Chrome trace of the timed frames" << std::endl;
+			return 1;
+		}
+	}
+
+	//------------  initialization ------------
+
+	//prefer a context with no window at all; fall back to a hidden window where that isn't available:
+	Headless headless;
+	SDL_Window *window = nullptr;
+	SDL_GLContext context = nullptr;
+	GLuint framebuffer = 0, framebuffer_color = 0, framebuffer_depth = 0;
+	GPUTimers gpu_timers; //(declared here so teardown can release its queries)
+	//(every exit after this point goes through here)
+	auto teardown = [&]() {
+		gpu_timers.release();
+		if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+		if (framebuffer_color) glDeleteRenderbuffers(1, &framebuffer_color);
+		if (framebuffer_depth) glDeleteRenderbuffers(1, &framebuffer_depth);
+		if (context) SDL_GL_DeleteContext(context);
+		if (window) SDL_DestroyWindow(window);
+	};
+	{
+		std::string error;
+		if (!headless.create(&error)) {
+			std::cerr << "NOTE: no headless OpenGL context (" << error << "); using a hidden window." << std::endl;
+			SDL_Init(SDL_INIT_VIDEO);
+			SDL_GL_ResetAttributes();
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+			window = SDL_CreateWindow("scene_bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+			if (!window) {
+				std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+				return 1;
+			}
+			context = SDL_GL_CreateContext(window);
+			if (!context) {
+				SDL_DestroyWindow(window);
+				std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+				return 1;
+			}
+			//don't let vsync pace the frames:
+			SDL_GL_SetSwapInterval(0);
+		}
+	}
+
+	#ifdef _WIN32
+	//On windows, load OpenGL extensions:
+	if (!init_gl_shims()) {
+		std::cerr << "ERROR: failed to initialize shims." << std::endl;
+		teardown();
+		return 1;
+	}
+	#endif
+
+	//render into a framebuffer object either way, so the target size doesn't depend on a window:
+	glGenRenderbuffers(1, &framebuffer_color);
+	glBindRenderbuffer(GL_RENDERBUFFER, framebuffer_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, config.size.x, config.size.y);
+	glGenRenderbuffers(1, &framebuffer_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, framebuffer_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, config.size.x, config.size.y);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, framebuffer_color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, framebuffer_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Error creating offscreen framebuffer." << std::endl;
+		teardown();
+		return 1;
+	}
+	glViewport(0, 0, config.size.x, config.size.y);
+
+	Programs programs;
+
+	//------------ meshes ------------
+
+	std::mt19937 mt(config.seed);
+	auto random = [&mt](float min, float max) { return min + (max - min) * (mt() % 10000) * 0.0001f; };
+
+	uint32_t mesh_count = std::max(1U, uint32_t(std::round(config.objects / config.reuse)));
+	uint32_t triangles_per_frame = 0;
+	Meshes meshes;
+	meshes.quantize = config.quantize;
+	meshes.lods = config.lods;
+	std::vector< Mesh const * > mesh_list;
+	{ //generate meshes, which get welded and uploaded to one VAO:
+		std::vector< Meshes::Vertex > triangles;
+		std::vector< Meshes::Range > ranges;
+		for (uint32_t m = 0; m < mesh_count; ++m) {
+			Meshes::Range range;
+			range.name = "mesh" + std::to_string(m);
+			range.vertex_start = uint32_t(triangles.size());
+			make_mesh(mt, config.detail, &triangles);
+			range.vertex_count = uint32_t(triangles.size()) - range.vertex_start;
+			ranges.emplace_back(range);
+		}
+		meshes.add(triangles.data(), triangles.size(), ranges, programs.attributes(), "scene_bench");
+		for (auto const &range : ranges) {
+			mesh_list.emplace_back(&meshes.get(range.name));
+		}
+	}
+
+	//------------ scene ------------
+
+	ThreadPool pool(config.threads - 1);
+	Scene scene;
+	scene.pool = &pool;
+	scene.lods = config.lods;
+	scene.camera.fovy = glm::radians(60.0f);
+	scene.camera.aspect = float(config.size.x) / float(config.size.y);
+
+	//roots are spread through a cube that grows with the object count (so density stays about the same):
+	float extent = 2.0f * std::cbrt(float(config.objects));
+
+	std::vector< Scene::ObjectHandle > objects;
+	std::vector< uint32_t > depths; //1 for roots
+	std::vector< float > spins; //radians per second about the local z axis (0 for objects that don't move)
+	objects.reserve(config.objects);
+	depths.reserve(config.objects);
+	spins.reserve(config.objects);
+	uint32_t max_depth = 0;
+	for (uint32_t i = 0; i < config.objects; ++i) {
+		//most objects get a parent, picked at random from those with room below them:
+		uint32_t parent = -1U;
+		if (config.depth > 1 && i > 0 && mt() % 4 != 0) {
+			for (uint32_t attempt = 0; attempt < 4 && parent == -1U; ++attempt) {
+				uint32_t candidate = mt() % i;
+				if (depths[candidate] < config.depth) parent = candidate;
+			}
+		}
+
+		objects.emplace_back(scene.objects.emplace());
+		Scene::Object &object = scene.objects[objects.back()];
+		Mesh const &mesh = *mesh_list[mt() % mesh_count];
+		object.vao = mesh.vao;
+		object.start = mesh.start;
+		object.count = mesh.count;
+		object.mesh_index = mesh.index;
+		object.bbox_min = mesh.bbox_min;
+		object.bbox_max = mesh.bbox_max;
+		object.sphere_center = mesh.sphere_center;
+		object.sphere_radius = mesh.sphere_radius;
+		object.dequantize_scale = mesh.dequantize_scale;
+		object.dequantize_offset = mesh.dequantize_offset;
+		for (uint32_t l = 0; l < mesh.lod_count; ++l) {
+			object.lods[l].start = mesh.lods[l].start;
+			object.lods[l].count = mesh.lods[l].count;
+			object.lods[l].error = mesh.lods[l].error;
+		}
+		object.lod_count = mesh.lod_count;
+		programs.set(object, config.mode);
+
+		object.transform.set_rotation(glm::angleAxis(random(0.0f, 6.28f), glm::normalize(glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), 1.0f))));
+		if (parent == -1U) {
+			object.transform.set_position(glm::vec3(random(0.0f, extent), random(0.0f, extent), random(0.0f, extent)));
+			depths.emplace_back(1);
+		} else {
+			object.transform.set_position(glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f)));
+			object.transform.set_scale(glm::vec3(random(0.6f, 1.0f)));
+			object.transform.set_parent(&scene.objects[objects[parent]].transform);
+			depths.emplace_back(depths[parent] + 1);
+		}
+		max_depth = std::max(max_depth, depths.back());
+		spins.emplace_back(random(0.0f, 1.0f) < config.moving ? random(-2.0f, 2.0f) : 0.0f);
+		triangles_per_frame += mesh.count / 3;
+	}
+
+	{ //a sun, plus point lights scattered through the scene:
+		scene.lights.emplace_back();
+		Scene::Light &sun = scene.lights.back();
+		sun.type = Scene::Light::Directional;
+		sun.transform.set_rotation(glm::angleAxis(0.3f, glm::vec3(-1.0f, 0.0f, 0.0f)));
+		sun.intensity = glm::vec3(1.5f);
+	}
+	for (uint32_t l = 0; l < config.lights; ++l) {
+		scene.lights.emplace_back();
+		Scene::Light &light = scene.lights.back();
+		light.type = Scene::Light::Point;
+		light.transform.set_position(glm::vec3(random(0.0f, extent), random(0.0f, extent), random(0.0f, extent)));
+		light.intensity = glm::vec3(random(0.5f, 3.0f), random(0.5f, 3.0f), random(0.5f, 3.0f));
+		light.range = 4.0f;
+	}
+
+	{ //camera just inside one side, looking across the scene (so some, but not all, objects get culled):
+		glm::vec3 target = glm::vec3(0.5f * extent, 0.5f * extent, 0.4f * extent);
+		scene.camera.transform.set_position(glm::vec3(0.5f * extent, 0.05f * extent, 0.6f * extent));
+		glm::vec3 out = -glm::normalize(target - scene.camera.transform.position);
+		glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+		up = glm::normalize(up - glm::dot(up, out) * out);
+		glm::vec3 right = glm::cross(up, out);
+		scene.camera.transform.set_rotation(glm::quat_cast(glm::mat3(right, up, out)));
+	}
+
+	std::cout << "scene_bench: " << config.objects << " objects (max depth " << max_depth << "), "
+	          << mesh_count << " meshes, " << scene.lights.size() << " lights, " << config.threads << " thread(s), "
+	          << Programs::mode_name(config.mode) << ", " << config.size.x << "x" << config.size.y << std::endl;
+	std::cout << "  meshes: " << meshes.stats.unrolled_vertices << " vertices welded to " << meshes.stats.vertices
+	          << "; " << meshes.stats.transformed_before << " vertex shader runs before reordering, " << meshes.stats.transformed << " after;\n"
+	          << "    " << (config.quantize ? "quantized" : "float") << " vertices, " << meshes.stats.vertex_bytes << " bytes uploaded in "
+	          << meshes.stats.upload_seconds * 1000.0 << " ms;\n"
+	          << "    " << meshes.stats.triangles << " triangles, plus " << meshes.stats.lod_triangles << " in levels of detail." << std::endl;
+
+	//------------ frames ------------
+
+	std::vector< double > update_ms, prepare_ms, render_ms, frame_ms;
+	uint32_t drawn = 0, draw_calls = 0, simplified = 0, triangles_drawn = 0;
+	uint32_t state_changes = 0, state_changes_saved = 0, uniform_uploads = 0;
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	for (uint32_t frame = 0; frame < config.warmup + config.frames; ++frame) {
+		if (frame == config.warmup) gpu_timers.reset_totals();
+		const float Elapsed = 1.0f / 60.0f; //(fixed, so runs are repeatable)
+
+		auto frame_before = Clock::now();
+
+		auto before = Clock::now();
+		{ //animate:
+			PROFILE_ZONE("update");
+			for (uint32_t i = 0; i < config.objects; ++i) {
+				if (spins[i] == 0.0f) continue;
+				Scene::Transform &transform = scene.objects[objects[i]].transform;
+				transform.set_rotation(glm::normalize(transform.rotation * glm::angleAxis(spins[i] * Elapsed, glm::vec3(0.0f, 0.0f, 1.0f))));
+			}
+		}
+		double update = ms_since(before);
+
+		//world matrices (and bounds, culling, and sorting) are updated here, so time them on their own:
+		before = Clock::now();
+		scene.prepare();
+		double prepare = ms_since(before);
+
+		gpu_timers.begin("clear");
+		glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		gpu_timers.end();
+
+		before = Clock::now();
+		gpu_timers.begin("scene");
+		scene.submit();
+		gpu_timers.end();
+		double render = ms_since(before);
+
+		{ //wait for the frame to finish, so frame times include the GPU:
+			PROFILE_ZONE("finish");
+			glFinish();
+		}
+		gpu_timers.frame();
+		PROFILE_FRAME();
+
+		if (frame >= config.warmup) {
+			update_ms.emplace_back(update);
+			prepare_ms.emplace_back(prepare);
+			render_ms.emplace_back(render);
+			frame_ms.emplace_back(ms_since(frame_before));
+			drawn = scene.stats.drawn;
+			draw_calls = scene.stats.draw_calls;
+			simplified = scene.stats.simplified;
+			triangles_drawn = scene.stats.triangles;
+			state_changes = scene.stats.state_changes;
+			state_changes_saved = scene.stats.state_changes_saved;
+			uniform_uploads = scene.stats.uniform_uploads;
+		}
+	}
+	gpu_timers.finish();
+
+	//------------ results ------------
+
+	Summary update = summarize(update_ms);
+	Summary prepare = summarize(prepare_ms);
+	Summary render = summarize(render_ms);
+	Summary total = summarize(frame_ms);
+	double objects_per_second = config.objects / (total.mean * 1e-3);
+
+	auto print = [](char const *name, Summary const &summary) {
+		std::cout << "  " << name << ": mean " << summary.mean << " ms, p50 " << summary.p50 << ", p90 " << summary.p90
+		          << ", p99 " << summary.p99 << ", max " << summary.max << std::endl;
+	};
+	std::cout << config.frames << " frames; " << drawn << " objects drawn in " << draw_calls << " draw calls per frame ("
+	          << triangles_per_frame << " triangles in the scene);\n"
+	          << "  " << simplified << " of them at a coarser level of detail, for " << triangles_drawn << " triangles drawn;\n"
+	          << "  " << state_changes << " program/VAO binds (" << state_changes_saved << " skipped as redundant) and " << uniform_uploads << " uniform uploads." << std::endl;
+	print("update", update);
+	print("prepare", prepare);
+	print("render", render);
+	print("frame", total);
+	for (auto const &t : gpu_timers.totals) {
+		std::cout << "  GPU " << t.name << ": mean " << (t.seconds / t.count * 1000.0) << " ms" << std::endl;
+	}
+	std::cout << "  throughput: " << objects_per_second << " objects/s (" << (1000.0 / total.mean) << " frames/s)" << std::endl;
+	if (gpu_timers.dropped) {
+		std::cout << "  (" << gpu_timers.dropped << " frames' GPU times arrived too late to count)" << std::endl;
+	}
+
+	if (!config.json.empty()) {
+		std::ofstream out(config.json, std::ios::binary);
+		auto summary_json = [&out](Summary const &summary) {
+			out << "{\"mean\":" << summary.mean << ",\"p50\":" << summary.p50 << ",\"p90\":" << summary.p90
+			    << ",\"p99\":" << summary.p99 << ",\"max\":" << summary.max << "}";
+		};
+		out << "{\n";
+		out << "\"config\":{\"objects\":" << config.objects << ",\"depth\":" << config.depth << ",\"reuse\":" << config.reuse
+		    << ",\"lights\":" << config.lights << ",\"moving\":" << config.moving << ",\"frames\":" << config.frames
+		    << ",\"warmup\":" << config.warmup << ",\"threads\":" << config.threads << ",\"mode\":\"" << Programs::mode_name(config.mode)
+		    << "\",\"vertices\":\"" << (config.quantize ? "quantized" : "float") << "\",\"lods\":" << (config.lods ? "true" : "false") << ",\"detail\":" << config.detail << ",\"width\":" << config.size.x << ",\"height\":" << config.size.y << ",\"seed\":" << config.seed << "},\n";
+		out << "\"scene\":{\"meshes\":" << mesh_count << ",\"max_depth\":" << max_depth << ",\"triangles\":" << triangles_per_frame
+		    << ",\"drawn\":" << drawn << ",\"draw_calls\":" << draw_calls << ",\"simplified\":" << simplified << ",\"triangles_drawn\":" << triangles_drawn
+		    << ",\"state_changes\":" << state_changes << ",\"state_changes_saved\":" << state_changes_saved << ",\"uniform_uploads\":" << uniform_uploads
+		    << ",\"unrolled_vertices\":" << meshes.stats.unrolled_vertices << ",\"vertices\":" << meshes.stats.vertices
+		    << ",\"transformed_before\":" << meshes.stats.transformed_before << ",\"transformed\":" << meshes.stats.transformed
+		    << ",\"lod_triangles\":" << meshes.stats.lod_triangles << ",\"vertex_bytes\":" << meshes.stats.vertex_bytes << ",\"upload_ms\":" << meshes.stats.upload_seconds * 1000.0 << "},\n";
+		out << "\"update_ms\":"; summary_json(update); out << ",\n";
+		out << "\"prepare_ms\":"; summary_json(prepare); out << ",\n";
+		out << "\"render_ms\":"; summary_json(render); out << ",\n";
+		out << "\"frame_ms\":"; summary_json(total); out << ",\n";
+		out << "\"gpu_ms\":{";
+		for (auto const &t : gpu_timers.totals) {
+			out << (&t == &gpu_timers.totals[0] ? "" : ",") << "\"" << t.name << "\":" << (t.seconds / t.count * 1000.0);
+		}
+		out << "},\n";
+		out << "\"objects_per_second\":" << objects_per_second << "\n";
+		out << "}\n";
+		if (!out) {
+			std::cerr << "Failed to write '" << config.json << "'." << std::endl;
+			teardown();
+			return 1;
+		}
+		std::cout << "Wrote results to '" << config.json << "'." << std::endl;
+	}
+
+	if (!config.trace.empty()) {
+		if (!Profiler::write_trace(config.trace, config.frames)) {
+			std::cerr << "Failed to write '" << config.trace << "'." << std::endl;
+			teardown();
+			return 1;
+		}
+	}
+
+	//------------  teardown ------------
+
+	teardown();
+
+	return 0;
+}
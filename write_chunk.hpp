@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+
+//writes 'from' as a chunk with the given (four-character) magic, the way older blobs were laid out:
+// (see BlobWriter in Blob.hpp for the current format)
+template< typename T >
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *_to) {
+	assert(_to);
+	auto &to = *_to;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (magic.size() != 4) {
+		throw std::runtime_error("Chunk magic should be four characters");
+	}
+
+	ChunkHeader header;
+	for (uint32_t i = 0; i < 4; ++i) {
+		header.magic[i] = magic[i];
+	}
+	header.size = uint32_t(from.size() * sizeof(T));
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(from.data()), from.size() * sizeof(T));
+}